@@ -0,0 +1,175 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+#include "ChannelMap.hh"
+
+static_assert( sizeof(ChannelMapHeader) == 24, "ChannelMapHeader layout changed" );
+static_assert( sizeof(ChannelMapRecord) == 24, "ChannelMapRecord layout changed" );
+
+void ChannelMap::clear(){
+  fRecords.clear();
+  fStrings.clear();
+  intern( "NotUsed" ); // Plane of FEM channels not connected to a wire
+  intern( "N/A" ); // Their adapter connector
+  fill_lookup();
+}
+
+bool ChannelMap::read_text( const std::string& fileName, std::string& error ){
+  std::ifstream BNLFile( fileName );
+  if( !BNLFile.is_open() ){
+    error = "could not open " + fileName;
+    return false;
+  }
+  int larwire, origwire, adapterPin, analogConnector, analogPin, asic, asicch, fembch, femb, wib, adcdec;
+  std::string plane, adapterConnector, adchex;
+  while( BNLFile >> larwire >> origwire >> plane >> adapterConnector >> adapterPin >> analogConnector >> analogPin >>
+	 asic >> asicch >> fembch >> femb >> wib >> adcdec >> adchex ){
+    // ASIC number goes from 1-8 in text file. We subtract 1 to make it 0-7 (used by the binary file)
+    uint16_t key = bnl_key( femb, asic - 1, asicch );
+    if( fByKey[key] >= 0 ){
+      std::ostringstream message;
+      message << "the triplet FEMB " << (femb & 0xF) << " ASIC " << (((asic - 1) & 0xF) + 1) << " ASICch " << (asicch & 0xF)
+	      << " is not unique in " << fileName;
+      error = message.str();
+      return false;
+    }
+    if( fStrings.size() > 254 ){
+      error = "too many plane and connector names in " + fileName;
+      return false;
+    }
+    ChannelMapRecord& record = add_key( key );
+    record.larWire = larwire;
+    record.origWire = origwire;
+    record.plane = intern( plane );
+    record.adapterConnector = intern( adapterConnector );
+    record.adapterPin = adapterPin;
+    record.analogConnector = analogConnector;
+    record.analogPin = analogPin;
+    record.asic = asic - 1;
+    record.asicch = asicch;
+    record.fembch = fembch;
+    record.femb = femb;
+    record.wib = wib;
+    record.adc = adcdec;
+  }
+  return true;
+}
+
+void ChannelMap::set_fem_channel( uint16_t key, int slot, int femch ){
+  ChannelMapRecord& record = add_key( key );
+  record.slot = slot;
+  record.femch = femch;
+  // Make sure all channels have their BNL address
+  record.asicch = key & 0xF;
+  record.asic = (key >> 4) & 0xF;
+  record.femb = (key >> 8) & 0xF;
+  if( slot >= 0 && slot < (int)kSlots && femch >= 0 && femch < 64 ) fBySlotChannel[64*slot + femch] = fByKey[key];
+}
+
+bool ChannelMap::save( const std::string& fileName ) const {
+  // Records in key order
+  std::vector<ChannelMapRecord> records( fRecords );
+  std::sort( records.begin(), records.end(), []( const ChannelMapRecord& a, const ChannelMapRecord& b ){ return a.key < b.key; } );
+  std::string strings;
+  for(size_t s = 0; s < fStrings.size(); s++) strings.append( fStrings[s].c_str(), fStrings[s].size() + 1 );
+
+  ChannelMapHeader fileHeader;
+  std::memset( &fileHeader, 0, sizeof(fileHeader) );
+  std::memcpy( fileHeader.magic, kChannelMapMagic, sizeof(kChannelMapMagic) );
+  fileHeader.version = kChannelMapVersion;
+  fileHeader.nchannels = records.size();
+  fileHeader.nstrings = fStrings.size();
+  fileHeader.stringBytes = strings.size();
+
+  FILE* file = fopen( fileName.c_str(), "wb" );
+  if( !file ) return false;
+  bool ok = (fwrite( &fileHeader, sizeof(fileHeader), 1, file ) == 1);
+  ok = ok && (fwrite( records.data(), sizeof(ChannelMapRecord), records.size(), file ) == records.size());
+  ok = ok && (fwrite( strings.data(), 1, strings.size(), file ) == strings.size());
+  ok = (fclose( file ) == 0) && ok;
+  return ok;
+}
+
+bool ChannelMap::load( const std::string& fileName ){
+  clear();
+  FILE* file = fopen( fileName.c_str(), "rb" );
+  if( !file ) return false;
+  ChannelMapHeader fileHeader;
+  bool ok = (fread( &fileHeader, sizeof(fileHeader), 1, file ) == 1)
+    && std::memcmp( fileHeader.magic, kChannelMapMagic, sizeof(kChannelMapMagic) ) == 0
+    && fileHeader.version == kChannelMapVersion
+    && fileHeader.nchannels <= kKeys && fileHeader.nstrings <= 256;
+  std::string strings;
+  if( ok ){
+    fRecords.resize( fileHeader.nchannels );
+    strings.resize( fileHeader.stringBytes );
+    ok = (fread( fRecords.data(), sizeof(ChannelMapRecord), fRecords.size(), file ) == fRecords.size())
+      && (fread( &strings[0], 1, strings.size(), file ) == strings.size());
+  }
+  fclose( file );
+  // Split the string table
+  fStrings.clear();
+  for(size_t begin = 0; ok && begin < strings.size() && fStrings.size() < fileHeader.nstrings; ){
+    size_t end = strings.find( '\0', begin );
+    if( end == std::string::npos ) break;
+    fStrings.push_back( strings.substr( begin, end - begin ) );
+    begin = end + 1;
+  }
+  ok = ok && (fStrings.size() == fileHeader.nstrings);
+  for(size_t r = 0; ok && r < fRecords.size(); r++){
+    ok = (fRecords[r].plane < fStrings.size()) && (fRecords[r].adapterConnector < fStrings.size());
+  }
+  if( !ok ){
+    clear();
+    return false;
+  }
+  fill_lookup();
+  return true;
+}
+
+uint8_t ChannelMap::intern( const std::string& text ){
+  std::vector<std::string>::iterator it = std::find( fStrings.begin(), fStrings.end(), text );
+  if( it != fStrings.end() ) return it - fStrings.begin();
+  fStrings.push_back( text );
+  return fStrings.size() - 1;
+}
+
+ChannelMapRecord& ChannelMap::add_key( uint16_t key ){
+  key &= (kKeys - 1);
+  if( fByKey[key] < 0 ){
+    ChannelMapRecord record;
+    record.larWire = -1;
+    record.origWire = -1;
+    record.adapterPin = -1;
+    record.analogConnector = -1;
+    record.analogPin = -1;
+    record.fembch = -1;
+    record.adc = -1;
+    record.key = key;
+    record.asic = -1;
+    record.asicch = -1;
+    record.femb = -1;
+    record.wib = -1;
+    record.slot = -1;
+    record.femch = -1;
+    record.plane = 0;
+    record.adapterConnector = 1;
+    fByKey[key] = fRecords.size();
+    fRecords.push_back( record );
+  }
+  return fRecords[fByKey[key]];
+}
+
+void ChannelMap::fill_lookup(){
+  std::fill( fBySlotChannel, fBySlotChannel + kSlots*64, -1 );
+  std::fill( fByKey, fByKey + kKeys, -1 );
+  for(size_t r = 0; r < fRecords.size(); r++){
+    const ChannelMapRecord& record = fRecords[r];
+    fByKey[record.key & (kKeys - 1)] = r;
+    if( record.slot >= 0 && record.slot < (int)kSlots && record.femch >= 0 && record.femch < 64 ) fBySlotChannel[64*record.slot + record.femch] = r;
+  }
+}
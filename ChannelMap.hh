@@ -0,0 +1,102 @@
+#ifndef CHANNELMAP_HH
+#define CHANNELMAP_HH
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Channel map of the TPC: LArSoft wire and BNL electronics address of every Nevis FEM channel
+// Built by channel_mapper.exe from the BNL pin map and a mapper run, and saved as a binary file (.chmap)
+// that is loaded with two reads and looked up through dense arrays, by (slot, FEM channel) or by BNL key
+//
+//   ChannelMapHeader                      (24 bytes)
+//   ChannelMapRecord x nchannels          (24 bytes each, in BNL key order)
+//   String table                          (plane and connector names, '\0'-terminated, nstrings of them)
+//
+// All values are little-endian
+
+const char kChannelMapMagic[8] = {'N', 'E', 'V', 'I', 'S', 'M', 'A', 'P'};
+const uint32_t kChannelMapVersion = 1;
+
+struct ChannelMapHeader{
+  char magic[8];
+  uint32_t version;
+  uint32_t nchannels;
+  uint32_t nstrings;
+  uint32_t stringBytes; // Size of the string table
+};
+
+// One channel. -1 where a value is unknown (e.g. FEM channels not connected to a wire)
+struct ChannelMapRecord{
+  int16_t larWire; // LArSoft wire
+  int16_t origWire; // TPC wire within plane
+  int16_t adapterPin; // BNL adapter board pin
+  int16_t analogConnector; // BNL analog board connector
+  int16_t analogPin; // BNL analog board pin
+  int16_t fembch; // BNL FEM channel
+  int16_t adc; // Channel-map mode ADC value
+  uint16_t key; // BNL key: FEMB << 8 | ASIC << 4 | ASIC channel (ASIC 0-7)
+  int8_t asic; // BNL ASIC number (0-7)
+  int8_t asicch; // BNL ASIC channel
+  int8_t femb; // BNL FEMB number
+  int8_t wib; // WIB number
+  int8_t slot; // Nevis FEM slot within crate
+  int8_t femch; // Channel within Nevis FEM
+  uint8_t plane; // Plane within TPC (string table index)
+  uint8_t adapterConnector; // BNL adapter board connector (string table index)
+};
+
+// BNL key of an electronics address, as produced by the BNL electronics running in channel-map mode
+inline uint16_t bnl_key( int femb, int asic, int asicch ){
+  return ((femb & 0xF) << 8) | ((asic & 0xF) << 4) | (asicch & 0xF);
+}
+
+class ChannelMap{
+public:
+  static const size_t kSlots = 32; // Slots of a crate
+  static const size_t kKeys = 4096; // 12-bit BNL keys
+
+  ChannelMap(){ clear(); };
+  void clear();
+
+  // BNL pin map saved as text, columns separated by spaces:
+  // larwire origwire plane adapterconnector adapterpin analogconnector analogpin asic(1-8) asicch fembch femb wib adcdec adchex
+  // Returns false if the file cannot be read or a key is repeated ("error" tells which)
+  bool read_text( const std::string& fileName, std::string& error );
+
+  // Nevis FEM channel that reads the BNL key (from a mapper run). Keys missing from the pin map are added
+  void set_fem_channel( uint16_t key, int slot, int femch );
+
+  bool save( const std::string& fileName ) const;
+  bool load( const std::string& fileName ); // Returns false if the file is missing or not a channel map
+
+  // nullptr if the channel is not in the map
+  const ChannelMapRecord* find( int slot, int femch ) const {
+    if( slot < 0 || slot >= (int)kSlots || femch < 0 || femch >= 64 ) return nullptr;
+    int32_t r = fBySlotChannel[64*slot + femch];
+    return (r < 0) ? nullptr : &fRecords[r];
+  };
+  const ChannelMapRecord* find_key( uint16_t key ) const {
+    int32_t r = fByKey[key & (kKeys - 1)];
+    return (r < 0) ? nullptr : &fRecords[r];
+  };
+
+  size_t size() const { return fRecords.size(); };
+  const ChannelMapRecord& record( size_t i ) const { return fRecords[i]; };
+  const std::string& string( uint8_t i ) const { return fStrings[i]; };
+  const std::string& plane( const ChannelMapRecord& record ) const { return fStrings[record.plane]; };
+  const std::string& adapter_connector( const ChannelMapRecord& record ) const { return fStrings[record.adapterConnector]; };
+
+private:
+  uint8_t intern( const std::string& text );
+  ChannelMapRecord& add_key( uint16_t key ); // Record of the key, created with unknown values if missing
+  void fill_lookup();
+
+  std::vector<ChannelMapRecord> fRecords; // In key order once saved or loaded
+  std::vector<std::string> fStrings; // Interned names
+  int32_t fBySlotChannel[kSlots*64]; // Record of (slot, FEM channel), -1 if none
+  int32_t fByKey[kKeys]; // Record of a BNL key, -1 if none
+};
+
+#endif
@@ -0,0 +1,108 @@
+#include <iostream>
+#include <algorithm>
+#include <random>
+
+#include "ChannelStats.hh"
+
+void ChannelAccumulator::add( const uint16_t* adc, size_t n ){
+  if( n == 0 ) return;
+  // Exact integer sums over the waveform (simple loop, vectorized by the compiler)
+  uint64_t sum = 0, sumSquares = 0;
+  uint16_t lo = 0xFFFF, hi = 0, bitsA = 0xFFFF, bitsO = 0;
+  for(size_t t = 0; t < n; t++){
+    uint32_t value = adc[t];
+    sum += value;
+    sumSquares += value*value;
+    lo = std::min<uint16_t>( lo, adc[t] );
+    hi = std::max<uint16_t>( hi, adc[t] );
+    bitsA &= adc[t];
+    bitsO |= adc[t];
+  }
+  ChannelAccumulator waveform;
+  waveform.samples = n;
+  waveform.frames = 1;
+  waveform.mean = (double)sum/n;
+  waveform.m2 = (double)((unsigned __int128)n*sumSquares - (unsigned __int128)sum*sum)/n; // Exact, whatever the length
+  waveform.min = lo;
+  waveform.max = hi;
+  waveform.bitsAnd = bitsA;
+  waveform.bitsOr = bitsO;
+  add( waveform );
+}
+
+void ChannelAccumulator::add( const ChannelAccumulator& other ){
+  if( other.samples == 0 ) return;
+  uint64_t total = samples + other.samples;
+  double delta = other.mean - mean;
+  mean += delta*other.samples/total;
+  m2 += other.m2 + delta*delta*((double)samples*other.samples/total);
+  samples = total;
+  frames += other.frames;
+  min = std::min( min, other.min );
+  max = std::max( max, other.max );
+  bitsAnd &= other.bitsAnd;
+  bitsOr |= other.bitsOr;
+}
+
+uint16_t ChannelAccumulator::toggling_bits() const {
+  if( samples < 2 || max <= min ) return 0;
+  uint16_t bits = 0;
+  for(unsigned b = 0; b < 12 && (1u << b) <= unsigned(max - min); b++) bits |= (1 << b);
+  return bits;
+}
+
+void ChannelStats::add( const FrameData& frame ){
+  if( frame.header.slot >= kSlots ) return;
+  ChannelAccumulator* channels = &fChannels[64*frame.header.slot];
+  for(size_t ch = 0; ch < 64; ch++) channels[ch].add( frame.channel(ch), frame.size(ch) );
+}
+
+void ChannelStats::add( const ChannelStats& other ){
+  for(size_t c = 0; c < fChannels.size(); c++) fChannels[c].add( other.fChannels[c] );
+}
+
+size_t ChannelStats::nchannels() const {
+  size_t n = 0;
+  for(size_t c = 0; c < fChannels.size(); c++) n += (fChannels[c].samples > 0);
+  return n;
+}
+
+bool check_channel_stats( unsigned seed ){
+  std::mt19937 rng( seed );
+  const int pedestals[] = {500, 1500, 2047, 2048, 3000, 4000}; // Off mid-scale and across carries
+  const double noise[] = {1., 3., 10.};
+  const uint16_t forced[] = {0x0, 0x1, 0x4}; // No bit, or one bit forced below the noise range
+  int nerrors = 0;
+  int nchecks = 0;
+  for(int pedestal : pedestals){
+    for(double sigma : noise){
+      for(uint16_t bit : forced){
+	for(int high = 0; high < 2; high++){
+	  if( bit == 0 && high ) continue;
+	  std::normal_distribution<double> gauss( pedestal, sigma );
+	  ChannelAccumulator acc;
+	  std::vector<uint16_t> adc( 2560 );
+	  for(int frame = 0; frame < 20; frame++){
+	    for(size_t t = 0; t < adc.size(); t++){
+	      int value = std::min( 4095, std::max( 0, (int)std::lround( gauss(rng) ) ) );
+	      adc[t] = high ? (value | bit) : (value & ~bit);
+	    }
+	    acc.add( adc.data(), adc.size() );
+	  }
+	  // A forced bit is only visible if the noise reaches the bit above it
+	  const bool visible = (bit != 0) && (acc.toggling_bits() & bit);
+	  const uint16_t expectHigh = (visible && high) ? bit : 0;
+	  const uint16_t expectLow = (visible && !high) ? bit : 0;
+	  nchecks++;
+	  if( acc.stuck_high() != expectHigh || acc.stuck_low() != expectLow || (bit != 0 && sigma >= 3. && !visible) ){
+	    std::cerr << "ERROR: Pedestal " << pedestal << ", RMS " << sigma << ", bit 0x" << std::hex << bit << (high ? " forced to 1" : " forced to 0")
+		      << ": stuckHigh 0x" << acc.stuck_high() << ", stuckLow 0x" << acc.stuck_low() << std::dec << std::endl;
+	    nerrors++;
+	  }
+	}
+      }
+    }
+  }
+  std::cout << "INFO: Checked the stuck bits of " << nchecks << " simulated channels: " << nerrors << " mismatches" << std::endl;
+  return nerrors == 0;
+}
@@ -0,0 +1,55 @@
+#ifndef CHANNELSTATS_HH
+#define CHANNELSTATS_HH
+
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <vector>
+
+#include "FrameDecoder.hh"
+
+// Noise statistics of one channel over a run: pedestal (mean), RMS, min/max and stuck bits
+// Each waveform is summed up in integers, then merged into the running mean and M2 (Welford/Chan update),
+// so the result does not lose precision over long runs
+struct ChannelAccumulator{
+  uint64_t samples = 0;
+  uint64_t frames = 0; // Waveforms with at least one sample
+  double mean = 0.;
+  double m2 = 0.; // Sum of squared differences from the mean
+  uint16_t min = 0xFFFF;
+  uint16_t max = 0;
+  uint16_t bitsAnd = 0xFFFF; // Bits set in every sample
+  uint16_t bitsOr = 0; // Bits set in any sample
+
+  void add( const uint16_t* adc, size_t n );
+  void add( const ChannelAccumulator& other ); // Merge two partial results
+  double rms() const { return samples > 0 ? std::sqrt( m2/samples ) : 0.; };
+  // Bits that must have changed for the samples to span [min, max]: bit b when max - min >= 2^b
+  // The high bits of a quiet channel never change and are not expected to
+  uint16_t toggling_bits() const;
+  // 12-bit ADC bits that should have toggled but never changed over the run (always 1, always 0)
+  uint16_t stuck_high() const { return bitsAnd & toggling_bits(); };
+  uint16_t stuck_low() const { return ~bitsOr & toggling_bits(); };
+};
+
+// Accumulators of all (slot, FEM channel) pairs of a crate, in one contiguous array
+class ChannelStats{
+public:
+  static const size_t kSlots = 32;
+
+  ChannelStats() : fChannels( kSlots*64 ) {};
+  void add( const FrameData& frame ); // Packed frame
+  void add( const ChannelStats& other );
+
+  const ChannelAccumulator& channel( size_t slot, size_t ch ) const { return fChannels[64*slot + ch]; };
+  size_t nchannels() const; // Channels with at least one sample
+
+private:
+  std::vector<ChannelAccumulator> fChannels; // By 64*slot + FEM channel
+};
+
+// Check the stuck-bit masks on noisy channels at several pedestals, healthy and with one bit forced to 0 or 1
+// Returns true if only the forced bits are flagged
+bool check_channel_stats( unsigned seed = 1 );
+
+#endif
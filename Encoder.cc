@@ -0,0 +1,203 @@
+#include <iostream>
+#include <random>
+#include <algorithm>
+
+#include "Encoder.hh"
+#include "FrameDecoder.hh"
+#include "Verifier.hh"
+#include "Logger.hh"
+
+// Huffman code of a difference: number of 0s before the 1 (-1 if the difference cannot be coded)
+static int huffman_zeros( int difference ){
+  switch( difference ){
+  case 0: return 0;
+  case -1: return 1;
+  case 1: return 2;
+  case -2: return 3;
+  case 2: return 4;
+  case -3: return 5;
+  case 3: return 6;
+  default: return -1;
+  }
+}
+
+// Encode one channel
+void encode_channel( std::vector<uint16_t>& words, uint16_t ch, const uint16_t* samples, size_t nsamples, bool huffman ){
+  words.push_back( 0x4000 | (ch & 0x3F) );
+  size_t t = 0;
+  while( t < nsamples ){
+    // The first sample of a channel is always a kADC word, as the decoder has nothing to add the difference to
+    int zeros = (huffman && t > 0) ? huffman_zeros( samples[t] - samples[t - 1] ) : -1;
+    if( zeros < 0 ){
+      words.push_back( samples[t] & 0xFFF );
+      t++;
+      continue;
+    }
+    // Codes are read from bit 13 down, latest sample first, so each new code goes on top and pushes the earlier ones down
+    uint16_t codes = 0;
+    int bits = 0;
+    while( zeros >= 0 && bits + zeros + 1 <= 14 ){
+      codes = (codes >> (zeros + 1)) | (1 << (13 - zeros));
+      bits += zeros + 1;
+      t++;
+      zeros = (t < nsamples) ? huffman_zeros( samples[t] - samples[t - 1] ) : -1;
+    }
+    words.push_back( 0x8000 | codes );
+  }
+  words.push_back( 0x5000 | (ch & 0x3F) );
+}
+
+// Encode one frame
+void encode_frame( std::vector<uint16_t>& words, HeaderInfo& header, const uint16_t* samples, const uint32_t* offsets, bool huffman ){
+  size_t headerBegin = words.size();
+  words.resize( headerBegin + 12 );
+  for(size_t ch = 0; ch < 64; ch++){
+    if( offsets[ch + 1] > offsets[ch] ) encode_channel( words, ch, samples + offsets[ch], offsets[ch + 1] - offsets[ch], huffman );
+  }
+  // Word count and checksum of the data words (padding is not counted)
+  uint32_t checksum = 0;
+  for(size_t w = headerBegin + 12; w < words.size(); w++) checksum += words[w];
+  header.nwords = (words.size() - headerBegin - 12) & 0xFFFFFF;
+  header.checksum = checksum & 0xFFFFFF;
+
+  uint16_t* headerWords = &words[headerBegin];
+  headerWords[0] = 0xFFFF;
+  headerWords[1] = 0xF000 | (header.full << 11) | (header.overflow << 10) | (header.test << 9) | ((header.id & 0xF) << 5) | (header.slot & 0x1F);
+  headerWords[2] = 0xF000 | ((header.nwords >> 12) & 0xFFF);
+  headerWords[3] = 0xF000 | (header.nwords & 0xFFF);
+  headerWords[4] = 0xF000 | ((header.event >> 12) & 0xFFF);
+  headerWords[5] = 0xF000 | (header.event & 0xFFF);
+  headerWords[6] = 0xF000 | ((header.frame >> 12) & 0xFFF);
+  headerWords[7] = 0xF000 | (header.frame & 0xFFF);
+  headerWords[8] = 0xF000 | ((header.checksum >> 12) & 0xFFF);
+  headerWords[9] = 0xF000 | (header.checksum & 0xFFF);
+  headerWords[10] = 0xF000 | ((header.triggerframe & 0xF) << 4) | ((header.triggersample >> 8) & 0xF);
+  headerWords[11] = 0xF000 | (header.triggersample & 0xFF);
+  if( (words.size() - headerBegin) % 2 ) words.push_back( 0x0000 ); // Padding outside channels is ignored by the decoder
+}
+
+// Pack pairs of words
+void pack_words( const std::vector<uint16_t>& words16b, std::vector<uint32_t>& words32b ){
+  words32b.reserve( words32b.size() + (words16b.size() + 1)/2 );
+  for(size_t w = 0; w < words16b.size(); w += 2){
+    uint32_t high = (w + 1 < words16b.size()) ? words16b[w + 1] : 0;
+    words32b.push_back( words16b[w] | (high << 16) );
+  }
+}
+
+// Compare a decoded frame with the frame that was encoded
+static bool same_frame( const FrameData& decoded, const HeaderInfo& header, const std::vector<uint16_t>& samples, const std::vector<uint32_t>& offsets ){
+  const HeaderInfo& h = decoded.header;
+  bool same = (h.id == header.id) && (h.slot == header.slot) && (h.test == header.test) && (h.overflow == header.overflow)
+    && (h.full == header.full) && (h.nwords == header.nwords) && (h.event == header.event) && (h.frame == header.frame)
+    && (h.checksum == header.checksum) && (h.triggerframe == header.triggerframe) && (h.triggersample == header.triggersample)
+    && ((h.wordcount & 0xFFFFFF) == header.nwords) && ((h.mychecksum & 0xFFFFFF) == header.checksum);
+  return same && (decoded.offsets == offsets) && (decoded.samples == samples);
+}
+
+// Random frames, decoded and re-encoded
+bool check_round_trip( unsigned seed, int nframes ){
+  std::mt19937 rng( seed );
+  std::uniform_int_distribution<int> smallStep(-3, 3);
+  std::uniform_int_distribution<int> anyValue(0, 4095);
+
+  // Waveforms mixing Huffman runs, jumps and the 0 and 4095 limits
+  std::vector<HeaderInfo> headers( nframes );
+  std::vector<std::vector<uint16_t> > samples( nframes );
+  std::vector<std::vector<uint32_t> > offsets( nframes, std::vector<uint32_t>(65, 0) );
+  std::vector<uint16_t> words16b;
+  for(int f = 0; f < nframes; f++){
+    HeaderInfo& header = headers[f];
+    header.slot = rng() & 0x1F;
+    header.id = rng() & 0xF;
+    header.test = rng() & 1;
+    header.overflow = rng() & 1;
+    header.full = rng() & 1;
+    header.event = rng() & 0xFFFFFF;
+    header.frame = rng() & 0xFFFFFF;
+    header.triggerframe = rng() & 0xF;
+    header.triggersample = rng() & 0xFFF;
+    for(size_t ch = 0; ch < 64; ch++){
+      size_t nsamples = (rng() % 8 == 0) ? 0 : 1 + rng() % 300; // Some channels are missing
+      int adc = (rng() % 4 == 0) ? ((rng() & 1) ? 0 : 4095) : anyValue(rng);
+      int mode = rng() % 3; // Flat, small steps or noisy
+      for(size_t t = 0; t < nsamples; t++){
+	if( t > 0 ){
+	  if( mode == 1 || (mode == 2 && rng() % 4) ) adc += smallStep(rng);
+	  else if( mode == 2 ) adc = anyValue(rng);
+	  adc = std::min( 4095, std::max( 0, adc ) );
+	}
+	samples[f].push_back( adc );
+      }
+      offsets[f][ch + 1] = samples[f].size();
+    }
+    encode_frame( words16b, header, samples[f].data(), offsets[f].data() );
+  }
+  std::vector<uint32_t> packed;
+  pack_words( words16b, packed );
+
+  // XMIT words between 32-bit words must be skipped by the decoders
+  std::vector<uint32_t> words32b;
+  for(size_t w = 0; w < packed.size(); w++){
+    if( rng() % 1000 == 0 ) words32b.push_back( (rng() & 1) ? 0xFFFFFFFF : 0xE0000000 );
+    words32b.push_back( packed[w] );
+  }
+
+  int nerrors = 0;
+  LogLevel level = log_level();
+  if( level < kWarning ) set_log_level( kWarning ); // No XMIT messages
+  // Frame decoder, as used by the threaded decoding
+  std::vector<FrameSpan> spans = scan_frames( words32b.data(), words32b.size() );
+  if( spans.size() != headers.size() ){
+    std::cerr << "ERROR: " << spans.size() << " frames found instead of " << headers.size() << std::endl;
+    set_log_level( level );
+    return false;
+  }
+  FrameData frame;
+  FrameCheck check;
+  std::vector<uint16_t> reencoded;
+  for(size_t f = 0; f < spans.size(); f++){
+    decode_frame( words32b.data(), spans[f], frame );
+    if( !same_frame( frame, headers[f], samples[f], offsets[f] ) ){
+      std::cerr << "ERROR: Frame " << f << " is not decoded bit-exactly by decode_frame" << std::endl;
+      nerrors++;
+    }
+    // Validation without decoding, as used by --verify-only
+    verify_frame( words32b.data(), spans[f], check );
+    if( !check.ok() || check.header.wordcount != headers[f].nwords || check.header.event != headers[f].event || check.header.slot != headers[f].slot ){
+      std::cerr << "ERROR: Frame " << f << " is not validated like the decoding does by verify_frame" << std::endl;
+      nerrors++;
+    }
+    encode_frame( reencoded, frame.header, frame.samples.data(), frame.offsets.data() );
+  }
+  if( reencoded != words16b ){
+    std::cerr << "ERROR: Re-encoded frames differ from the encoded frames" << std::endl;
+    nerrors++;
+  }
+
+  // Word-by-word decoder, as used by the serial decoding
+  DecoderState state;
+  frame.clear();
+  size_t f = 0;
+  auto compare = [&](){
+    frame.pack();
+    if( f >= headers.size() || !same_frame( frame, headers[f], samples[f], offsets[f] ) ){
+      std::cerr << "ERROR: Frame " << f << " is not decoded bit-exactly by decode_word" << std::endl;
+      nerrors++;
+    }
+    f++;
+  };
+  for(size_t w = 0; w < words32b.size(); w++){
+    if( is_xmit_word( words32b[w] ) ) continue;
+    for(size_t i = 0; i < 2; i++){
+      uint16_t word = (words32b[w] >> (16*i)) & 0xFFFF;
+      if( is_frame_start( word, state ) && w > 0 ) compare();
+      decode_word( word, state, frame );
+    }
+  }
+  compare();
+  set_log_level( level );
+
+  std::cout << "INFO: Encoded and decoded " << nframes << " frames (" << words16b.size() << " words): " << nerrors << " mismatches" << std::endl;
+  return nerrors == 0;
+}
@@ -0,0 +1,29 @@
+#ifndef ENCODER_HH
+#define ENCODER_HH
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include "HeaderInfo.hh"
+
+// Encoding of FEM frames in the Nevis binary format (the inverse of decode_frame)
+// A sample is written in a kADCHuffman word when it differs by at most 3 from the previous one, in a kADC word otherwise
+// Samples must fit in 12 bits
+
+// Append the channel header, the sample words and the channel ending of channel ch
+void encode_channel( std::vector<uint16_t>& words, uint16_t ch, const uint16_t* samples, size_t nsamples, bool huffman = true );
+
+// Append a frame: 12 header words, the channels and a 0x0000 padding word if needed to end on a 32-bit boundary
+// Channel ch is samples[offsets[ch], offsets[ch+1]) (65 offsets, as in FrameData); channels without samples are not written
+// header.nwords and header.checksum are set from the data words
+void encode_frame( std::vector<uint16_t>& words, HeaderInfo& header, const uint16_t* samples, const uint32_t* offsets, bool huffman = true );
+
+// Append 16-bit words as 32-bit words, the first word in the lower half (as in the DAQ files)
+void pack_words( const std::vector<uint16_t>& words16b, std::vector<uint32_t>& words32b );
+
+// Encode random frames, decode them with the frame and word-by-word decoders, re-encode the result
+// and compare everything (word counts and checksums of verify_frame too). Returns true if the round trip is bit-exact
+bool check_round_trip( unsigned seed = 1, int nframes = 500 );
+
+#endif
@@ -0,0 +1,105 @@
+#include <iostream>
+#include <algorithm>
+
+#include "EventBuilder.hh"
+#include "Logger.hh"
+
+EventBuilder::EventBuilder( unsigned firstSlot, unsigned nslots, size_t window )
+  : fFirstSlot(firstSlot), fNSlots(nslots), fWindow(window > 0 ? window : 1){
+  fAllSlots = 0;
+  for(unsigned s = firstSlot; s < firstSlot + nslots && s < 32; s++) fAllSlots |= (1u << s);
+}
+
+void EventBuilder::add( const FrameData& frame ){
+  const HeaderInfo& h = frame.header;
+  if( h.slot < fFirstSlot || h.slot >= fFirstSlot + fNSlots ){
+    LOG_WARNING( "WARNING: Frame of slot " << (int)h.slot << " (event " << h.event << ") is not in the crate and was dropped" );
+    fSummary.foreignFrames++;
+    return;
+  }
+  if( fAnyClosed && h.event <= fLastClosed ){
+    LOG_WARNING( "WARNING: Frame of slot " << (int)h.slot << " arrived after event " << h.event << " was built and was dropped" );
+    fSummary.lateFrames++;
+    return;
+  }
+  if( !fOpen.empty() && h.event < fOpen.rbegin()->first ) fSummary.reorderedFrames++;
+
+  std::map<uint32_t, OpenEvent>::iterator it = fOpen.find( h.event );
+  if( it == fOpen.end() ){
+    it = fOpen.emplace( h.event, OpenEvent() ).first;
+    OpenEvent& open = it->second;
+    open.event.event = h.event;
+    open.event.frame = h.frame;
+    open.event.headers.resize( fNSlots );
+    open.samples.resize( fNSlots );
+    open.offsets.resize( fNSlots );
+  }
+  OpenEvent& open = it->second;
+  size_t s = h.slot - fFirstSlot;
+  if( open.event.slots & (1u << h.slot) ){
+    LOG_WARNING( "WARNING: Second frame of slot " << (int)h.slot << " in event " << h.event << " was dropped" );
+    open.event.status |= kEventDuplicateFEM;
+    fSummary.duplicateFrames++;
+    return;
+  }
+  // Flagged as soon as the frame arrives, not when the event is closed
+  if( open.event.slots != 0 && h.frame != open.event.frame && !(open.event.status & kEventDesync) ){
+    LOG_WARNING( "WARNING: DESYNC in event " << h.event << ": slot " << (int)h.slot << " is at frame " << h.frame
+		 << ", the FEMs before it at frame " << open.event.frame );
+    open.event.status |= kEventDesync;
+  }
+  if( h.nwords != h.wordcount || h.checksum != h.mychecksum ) open.event.status |= kEventBadFrame;
+  open.event.headers[s] = h;
+  open.samples[s].assign( frame.samples.begin(), frame.samples.begin() + frame.offsets[64] );
+  open.offsets[s].assign( frame.offsets.begin(), frame.offsets.end() );
+  open.event.slots |= (1u << h.slot);
+
+  // The oldest event is closed once it is complete, or when the window is full
+  // A newer complete event waits for the older ones, so events come out in order
+  while( !fOpen.empty() && (fOpen.begin()->second.event.slots == fAllSlots || fOpen.size() > fWindow) ) close_oldest();
+}
+
+void EventBuilder::finish(){
+  while( !fOpen.empty() ) close_oldest();
+}
+
+bool EventBuilder::next( CrateEvent& event ){
+  if( fClosed.empty() ) return false;
+  std::swap( event, fClosed.front() );
+  fClosed.pop_front();
+  return true;
+}
+
+void EventBuilder::close_oldest(){
+  OpenEvent& open = fOpen.begin()->second;
+  CrateEvent& event = open.event;
+  event.status |= (event.slots == fAllSlots) ? kEventComplete : kEventMissingFEM;
+  if( !(event.status & kEventComplete) ){
+    LOG_WARNING( "WARNING: Event " << event.event << " built without " << __builtin_popcount( fAllSlots & ~event.slots ) << " FEMs" );
+  }
+
+  // Slots in crate order, 64 channels each
+  event.offsets.assign( 64*fNSlots + 1, 0 );
+  size_t nsamples = 0;
+  for(size_t s = 0; s < fNSlots; s++) nsamples += open.samples[s].size();
+  event.samples.resize( nsamples );
+  uint32_t begin = 0;
+  for(size_t s = 0; s < fNSlots; s++){
+    if( !open.samples[s].empty() ) std::copy( open.samples[s].begin(), open.samples[s].end(), event.samples.begin() + begin );
+    for(size_t ch = 0; ch < 64; ch++){
+      event.offsets[64*s + ch] = begin + (open.offsets[s].empty() ? 0 : open.offsets[s][ch]);
+    }
+    begin += open.samples[s].size();
+  }
+  event.offsets[64*fNSlots] = begin;
+
+  fSummary.events++;
+  if( event.status & kEventComplete ) fSummary.completeEvents++;
+  else fSummary.incompleteEvents++;
+  if( event.status & kEventDesync ) fSummary.desyncEvents++;
+  fAnyClosed = true;
+  fLastClosed = event.event;
+  fClosed.push_back( CrateEvent() );
+  std::swap( fClosed.back(), event );
+  fOpen.erase( fOpen.begin() );
+}
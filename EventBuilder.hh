@@ -0,0 +1,84 @@
+#ifndef EVENTBUILDER_HH
+#define EVENTBUILDER_HH
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <map>
+#include <deque>
+
+#include "HeaderInfo.hh"
+#include "FrameDecoder.hh"
+
+// Crate-level event building: the FEM frames of one trigger (same event number) are put together in one crate event
+// Frames are added in the order they are decoded. Up to "window" events are kept open, so FEMs read out of order
+// or late still reach their event; an event is closed when all the FEMs of the crate have arrived, or when newer
+// events push it out of the window (then it is flagged as incomplete). Events are closed in event-number order
+
+// Status bits of a crate event
+const uint32_t kEventComplete = 0x1; // Every FEM of the crate is present
+const uint32_t kEventMissingFEM = 0x2; // Some FEMs did not arrive within the window
+const uint32_t kEventDesync = 0x4; // The FEMs disagree on the frame number
+const uint32_t kEventDuplicateFEM = 0x8; // A FEM sent two frames for the event (the second one is dropped)
+const uint32_t kEventBadFrame = 0x10; // A frame failed the word count or checksum check
+
+// One trigger of the crate: "nslots" FEMs x 64 channels
+// Channel ch of the FEM in slot s is crate channel (s - firstSlot)*64 + ch, i.e. samples[offsets[c], offsets[c+1])
+// The channels of a missing FEM are empty and its header is cleared (slot 0)
+struct CrateEvent{
+  uint32_t event = 0;
+  uint32_t frame = 0; // Frame number of the first FEM that arrived
+  uint32_t status = 0;
+  uint32_t slots = 0; // Bit s is set if the FEM in slot s is present
+  std::vector<HeaderInfo> headers; // One per slot of the crate
+  std::vector<uint16_t> samples;
+  std::vector<uint32_t> offsets; // nslots*64 + 1 entries
+};
+
+// Counters of the event building of a run
+struct EventBuilderSummary{
+  size_t events = 0;
+  size_t completeEvents = 0;
+  size_t incompleteEvents = 0; // Closed with FEMs missing
+  size_t desyncEvents = 0;
+  size_t reorderedFrames = 0; // Frames that arrived while a newer event was already open
+  size_t lateFrames = 0; // Frames of events already closed (dropped)
+  size_t duplicateFrames = 0; // Dropped
+  size_t foreignFrames = 0; // Frames of slots outside the crate (dropped)
+};
+
+class EventBuilder{
+public:
+  // Crate with FEMs in slots firstSlot to firstSlot + nslots - 1
+  EventBuilder( unsigned firstSlot = 4, unsigned nslots = 10, size_t window = 4 );
+
+  void add( const FrameData& frame ); // After check_frame
+  void finish(); // Close all the open events
+  bool next( CrateEvent& event ); // Take the oldest closed event, false if there is none
+
+  const EventBuilderSummary& summary() const { return fSummary; };
+  unsigned first_slot() const { return fFirstSlot; };
+  unsigned nslots() const { return fNSlots; };
+
+private:
+  // Frames of an open event, one per slot of the crate
+  struct OpenEvent{
+    CrateEvent event;
+    std::vector< std::vector<uint16_t> > samples; // Per slot
+    std::vector< std::vector<uint32_t> > offsets;
+  };
+
+  void close_oldest();
+
+  unsigned fFirstSlot;
+  unsigned fNSlots;
+  size_t fWindow;
+  uint32_t fAllSlots; // Mask of the slots of the crate
+  std::map<uint32_t, OpenEvent> fOpen; // By event number
+  std::deque<CrateEvent> fClosed;
+  bool fAnyClosed = false;
+  uint32_t fLastClosed = 0; // Event number of the last closed event
+  EventBuilderSummary fSummary;
+};
+
+#endif
@@ -0,0 +1,140 @@
+#include <iostream>
+#include <algorithm>
+
+#include <TTree.h>
+#include <TDirectory.h>
+
+#include "EventView.hh"
+
+TTree* EventView::find_tree( TDirectory* file ){
+  TTree* tree = (TTree*)file->Get("decoderTree");
+  return tree ? tree : (TTree*)file->Get("roiTree");
+}
+
+bool EventView::attach( TTree* tree, Access access, Long64_t begin, Long64_t end ){
+  fTree = tree;
+  fEntries = tree->GetEntries();
+  fEntry = -1;
+  fLocalEntry = -1;
+  fHeaderBranch = tree->GetBranch("header");
+  if( !fHeaderBranch ){
+    std::cerr << "ERROR: No header branch found in tree" << std::endl;
+    return false;
+  }
+  fSamplesBranch = fOffsetsBranch = fWaveformBranch = nullptr;
+  fSizesBranch = fPedestalsBranch = fRoiChannelsBranch = fRoiStartsBranch = fRoiOffsetsBranch = nullptr;
+  if( tree->GetBranch("sizes") && tree->GetBranch("roiOffsets") ){
+    tree->SetBranchAddress("sizes", &fSizes, &fSizesBranch);
+    tree->SetBranchAddress("pedestals", &fPedestals, &fPedestalsBranch);
+    tree->SetBranchAddress("roiChannels", &fRoiChannels, &fRoiChannelsBranch);
+    tree->SetBranchAddress("roiStarts", &fRoiStarts, &fRoiStartsBranch);
+    tree->SetBranchAddress("roiOffsets", &fRoiOffsets, &fRoiOffsetsBranch);
+    tree->SetBranchAddress("samples", &fSamples, &fSamplesBranch);
+  }
+  else if( tree->GetBranch("samples") && tree->GetBranch("offsets") ){
+    tree->SetBranchAddress("samples", &fSamples, &fSamplesBranch);
+    tree->SetBranchAddress("offsets", &fOffsets, &fOffsetsBranch);
+  }
+  else if( tree->GetBranch("waveform") ){
+    std::cout << "INFO: Reading waveforms stored as vector< vector<uint16_t> >" << std::endl;
+    tree->SetBranchAddress("waveform", &fWaveform, &fWaveformBranch);
+  }
+  else{
+    std::cerr << "ERROR: No waveform branches found in tree" << std::endl;
+    return false;
+  }
+  tree->SetBranchAddress("header", &fHeader, &fHeaderBranch);
+
+  if( access == kSequential ){
+    tree->SetCacheSize( kCacheSize );
+    tree->SetCacheEntryRange( begin, (end < 0) ? fEntries : end );
+    tree->AddBranchToCache( "header", true ); // Always used; the waveform branches join when they are first read
+    tree->SetCacheLearnEntries( kLearnEntries );
+  }
+  else tree->SetCacheSize( 0 );
+  return true;
+}
+
+void EventView::detach(){
+  if( fTree ) fTree->ResetBranchAddresses();
+  fTree = nullptr;
+  fHeaderBranch = fSamplesBranch = fOffsetsBranch = fWaveformBranch = nullptr;
+  fSizesBranch = fPedestalsBranch = fRoiChannelsBranch = fRoiStartsBranch = fRoiOffsetsBranch = nullptr;
+}
+
+void EventView::set_entry( Long64_t entry ){
+  if( entry == fEntry ) return;
+  fEntry = entry;
+  fLocalEntry = fTree->LoadTree( entry ); // Moves the cache along, reads no branch
+  fHeaderRead = fOffsetsRead = fSamplesRead = false;
+}
+
+const HeaderInfo& EventView::header(){
+  if( !fHeaderRead ){
+    fHeaderBranch->GetEntry( fLocalEntry );
+    fHeaderRead = true;
+  }
+  return *fHeader;
+}
+
+void EventView::load_offsets(){
+  if( fOffsetsRead ) return;
+  if( fWaveformBranch ) load_samples(); // Sizes and samples are one branch
+  else if( fSizesBranch ){
+    fSizesBranch->GetEntry( fLocalEntry );
+    fExpandedOffsets.assign( 1, 0 );
+    for(size_t ch = 0; ch < fSizes->size(); ch++) fExpandedOffsets.push_back( fExpandedOffsets.back() + (*fSizes)[ch] );
+  }
+  else fOffsetsBranch->GetEntry( fLocalEntry );
+  fOffsetsRead = true;
+}
+
+void EventView::load_samples(){
+  if( fSamplesRead ) return;
+  if( fWaveformBranch ) fWaveformBranch->GetEntry( fLocalEntry );
+  else if( fSizesBranch ) expand_rois();
+  else fSamplesBranch->GetEntry( fLocalEntry );
+  fSamplesRead = true;
+}
+
+void EventView::expand_rois(){
+  load_offsets();
+  fPedestalsBranch->GetEntry( fLocalEntry );
+  fRoiChannelsBranch->GetEntry( fLocalEntry );
+  fRoiStartsBranch->GetEntry( fLocalEntry );
+  fRoiOffsetsBranch->GetEntry( fLocalEntry );
+  fSamplesBranch->GetEntry( fLocalEntry );
+  fExpanded.resize( fExpandedOffsets.back() );
+  for(size_t ch = 0; ch + 1 < fExpandedOffsets.size(); ch++){
+    std::fill( fExpanded.begin() + fExpandedOffsets[ch], fExpanded.begin() + fExpandedOffsets[ch + 1], (*fPedestals)[ch] );
+  }
+  for(size_t r = 0; r < fRoiChannels->size(); r++){
+    const size_t ch = (*fRoiChannels)[r];
+    if( ch >= fSizes->size() ) continue;
+    const size_t begin = std::min<size_t>( (*fRoiStarts)[r], (*fSizes)[ch] );
+    const size_t n = std::min<size_t>( (*fRoiOffsets)[r + 1] - (*fRoiOffsets)[r], (*fSizes)[ch] - begin ); // Stays in the channel
+    std::copy( fSamples->begin() + (*fRoiOffsets)[r], fSamples->begin() + (*fRoiOffsets)[r] + n, fExpanded.begin() + fExpandedOffsets[ch] + begin );
+  }
+}
+
+size_t EventView::nchannels(){
+  load_offsets();
+  if( fWaveform ) return fWaveform->size();
+  const std::vector<uint32_t>& offsets = fSizesBranch ? fExpandedOffsets : *fOffsets;
+  return offsets.empty() ? 0 : offsets.size() - 1;
+}
+
+size_t EventView::size( size_t ch ){
+  load_offsets();
+  if( fWaveform ) return (*fWaveform)[ch].size();
+  const std::vector<uint32_t>& offsets = fSizesBranch ? fExpandedOffsets : *fOffsets;
+  return offsets[ch + 1] - offsets[ch];
+}
+
+ChannelView EventView::channel( size_t ch ){
+  load_offsets();
+  load_samples();
+  if( fWaveform ) return ChannelView( (*fWaveform)[ch].data(), (*fWaveform)[ch].size() );
+  if( fSizesBranch ) return ChannelView( fExpanded.data() + fExpandedOffsets[ch], fExpandedOffsets[ch + 1] - fExpandedOffsets[ch] );
+  return ChannelView( fSamples->data() + (*fOffsets)[ch], (*fOffsets)[ch + 1] - (*fOffsets)[ch] );
+}
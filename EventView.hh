@@ -0,0 +1,105 @@
+#ifndef EVENTVIEW_HH
+#define EVENTVIEW_HH
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include <Rtypes.h>
+
+#include "HeaderInfo.hh"
+
+class TTree;
+class TBranch;
+class TDirectory;
+
+// Samples of one channel of the current entry of an EventView (valid until it moves to another entry)
+class ChannelView{
+public:
+  ChannelView( const uint16_t* data = nullptr, size_t size = 0 ) : fData(data), fSize(size) {};
+  const uint16_t* data() const { return fData; };
+  size_t size() const { return fSize; };
+  bool empty() const { return fSize == 0; };
+  uint16_t operator[]( size_t t ) const { return fData[t]; };
+  const uint16_t* begin() const { return fData; };
+  const uint16_t* end() const { return fData + fSize; };
+
+private:
+  const uint16_t* fData;
+  size_t fSize;
+};
+
+// Lazy access to the entries of decoderTree (or roiTree): moving to an entry reads nothing, and each branch is read the first
+// time the entry needs it (header, then channel sizes, then samples). Tools that only look at headers never read
+// waveforms, and entries skipped after a look at their header never have their samples read
+// The waveforms can be stored
+// - flat: "samples" (all channels in one buffer) and "offsets" (65 entries)
+// - legacy: "waveform" (vector of 64 vectors), written by older versions of the decoder
+// - zero-suppressed: roiTree, written by decoder.exe --roi (see Roi.hh). Each channel is rebuilt at its full size,
+//   at its pedestal outside the regions of interest
+// A branch is the smallest unit ROOT reads, so the first channel touched brings in the samples of all 64
+class EventView{
+public:
+  // decoderTree, or roiTree if the file is zero-suppressed. Null if there is neither
+  static TTree* find_tree( TDirectory* file );
+
+  // How the entries are visited, to tune the TTreeCache
+  // - kSequential: entries [begin, end) in order. The cache covers the range and learns, over the first
+  //   kLearnEntries entries, which branches are used, so the baskets of only those are prefetched
+  // - kRandom: jumps (e.g. an event display). No cache: a jump reads only the baskets of the entry it lands on
+  enum Access{ kSequential, kRandom };
+
+  static const Long64_t kCacheSize = 32 << 20; // Bytes
+  static const int kLearnEntries = 10;
+
+  // Returns false if the tree has no header or no waveforms. "end" < 0 means up to the last entry
+  bool attach( TTree* tree, Access access = kSequential, Long64_t begin = 0, Long64_t end = -1 );
+  void detach(); // Before the tree is deleted, so it forgets the addresses of the view
+
+  bool is_legacy() const { return fWaveformBranch != nullptr; };
+  bool is_roi() const { return fSizesBranch != nullptr; };
+  Long64_t entries() const { return fEntries; };
+  void set_entry( Long64_t entry );
+  Long64_t entry() const { return fEntry; };
+
+  // After set_entry
+  const HeaderInfo& header();
+  size_t nchannels();
+  size_t size( size_t ch ); // Number of samples in channel, without reading the samples (flat layout)
+  ChannelView channel( size_t ch );
+
+private:
+  void load_offsets();
+  void load_samples();
+  void expand_rois(); // Zero-suppressed waveforms of the current entry into fExpanded
+
+  TTree* fTree = nullptr;
+  Long64_t fEntries = 0;
+  Long64_t fEntry = -1;
+  Long64_t fLocalEntry = -1; // In the current tree, as given by TTree::LoadTree
+  TBranch* fHeaderBranch = nullptr;
+  TBranch* fSamplesBranch = nullptr;
+  TBranch* fOffsetsBranch = nullptr;
+  TBranch* fWaveformBranch = nullptr;
+  TBranch* fSizesBranch = nullptr; // Zero-suppressed
+  TBranch* fPedestalsBranch = nullptr;
+  TBranch* fRoiChannelsBranch = nullptr;
+  TBranch* fRoiStartsBranch = nullptr;
+  TBranch* fRoiOffsetsBranch = nullptr;
+  bool fHeaderRead = false; // For the current entry
+  bool fOffsetsRead = false;
+  bool fSamplesRead = false;
+  HeaderInfo* fHeader = nullptr;
+  std::vector<uint16_t>* fSamples = nullptr;
+  std::vector<uint32_t>* fOffsets = nullptr;
+  std::vector< std::vector<uint16_t> >* fWaveform = nullptr;
+  std::vector<uint32_t>* fSizes = nullptr;
+  std::vector<uint16_t>* fPedestals = nullptr;
+  std::vector<uint8_t>* fRoiChannels = nullptr;
+  std::vector<uint16_t>* fRoiStarts = nullptr;
+  std::vector<uint32_t>* fRoiOffsets = nullptr;
+  std::vector<uint16_t> fExpanded; // Rebuilt waveforms of a zero-suppressed entry, channel ch from fExpandedOffsets[ch]
+  std::vector<uint32_t> fExpandedOffsets;
+};
+
+#endif
@@ -0,0 +1,240 @@
+#include <iomanip>
+
+#include "FrameDecoder.hh"
+#include "Huffman.hh"
+#include "Logger.hh"
+
+// Word type as a function of the top nibble (0xF... is the first header word, offset by the header position)
+static const WordType kWordTypeTable[16] = {
+  kADC,           // 0x0: can also be 0x0000 padding...
+  kUnknown,       // 0x1
+  kUnknown,       // 0x2
+  kUnknown,       // 0x3
+  kChannelHeader, // 0x4
+  kChannelEnding, // 0x5
+  kUnknown,       // 0x6
+  kUnknown,       // 0x7
+  kADCHuffman,    // 0x8: Huffman words are 10xx...
+  kADCHuffman,    // 0x9
+  kADCHuffman,    // 0xA
+  kADCHuffman,    // 0xB
+  kUnknown,       // 0xC
+  kUnknown,       // 0xD
+  kUnknown,       // 0xE
+  kHeaderFirst    // 0xF
+};
+
+// Classify word
+WordType get_word_type( uint16_t word, DecoderState& state ){
+  int nibble = (word >> 12);
+  int isHeader = (nibble == 0xF);
+  WordType type = static_cast<WordType>( kWordTypeTable[nibble] + isHeader*state.headerCounter );
+  int next = state.headerCounter + isHeader;
+  state.headerCounter = (next == 12) ? 0 : next; // 12 header words per FEM frame
+  return type;
+}
+
+// Interpret one header word
+void decode_header_word( WordType type, uint16_t word, HeaderInfo& header ){
+  switch( type ){
+  case kHeaderIDSlot:
+    header.slot = (word & 0x1F);
+    header.id = ((word>>5) & 0xF);
+    header.test = ((word>>9) & 0x1);
+    header.overflow = ((word>>10) & 0x1);
+    header.full = ((word>>11) & 0x1);
+    LOG_DEBUG( "FEM " << (int)header.slot );
+    break;
+  case kHeaderNWordsMSB:
+    header.nwords += ((word & 0xFFF)<<12);
+    break;
+  case kHeaderNWordsLSB:
+    header.nwords += (word & 0xFFF);
+    break;
+  case kHeaderEventMSB:
+    header.event += ((word & 0xFFF)<<12);
+    break;
+  case kHeaderEventLSB:
+    header.event += (word & 0xFFF);
+    LOG_DEBUG( "Event " << (int)header.event );
+    break;
+  case kHeaderFrameMSB:
+    header.frame += ((word & 0xFFF)<<12);
+    break;
+  case kHeaderFrameLSB:
+    header.frame += (word & 0xFFF);
+    LOG_DEBUG( "Frame " << (int)header.frame );
+    break;
+  case kHeaderChecksumMSB:
+    header.checksum += ((word & 0xFFF)<<12);
+    break;
+  case kHeaderChecksumLSB:
+    header.checksum += (word & 0xFFF);
+    break;
+  case kHeaderSampleMSB:
+    header.triggerframe = ((word >> 4) & 0xF);
+    header.triggersample += ((word & 0xF)<<8);
+    break;
+  case kHeaderSampleLSB:
+    header.triggersample += (word & 0xFF);
+    break;
+  default: // kHeaderFirst has no content, other types are not header words
+    break;
+  }
+}
+
+// Interpret one word
+WordType decode_word( uint16_t word, DecoderState& state, FrameData& frame ){
+  HeaderInfo& header = frame.header;
+  WordType type = get_word_type( word, state );
+  switch( type ){
+  case kHeaderFirst:
+    // Reset
+    frame.clear();
+    state.currentChannel = 999;
+    break;
+  case kHeaderIDSlot:
+  case kHeaderNWordsMSB:
+  case kHeaderNWordsLSB:
+  case kHeaderEventMSB:
+  case kHeaderEventLSB:
+  case kHeaderFrameMSB:
+  case kHeaderFrameLSB:
+  case kHeaderChecksumMSB:
+  case kHeaderChecksumLSB:
+  case kHeaderSampleMSB:
+  case kHeaderSampleLSB:
+    decode_header_word( type, word, header );
+    break;
+  case kChannelHeader:
+    header.wordcount++;
+    header.mychecksum += word;
+    if( state.currentChannel != 999 ) frame.samples.resize( state.channelBegin ); // Drop a channel without ending
+    state.currentChannel = (word & 0x3F);
+    state.channelBegin = frame.samples.size();
+    LOG_DEBUG( "Reading channel " << state.currentChannel );
+    break;
+  case kADC:
+    if( state.currentChannel != 999 ){
+      header.wordcount++;
+      header.mychecksum += word;
+      frame.samples.push_back( (word & 0xFFF) );
+      //std::cout << "ADC value " << (word & 0xFFF) << std::endl;
+    } // else padding
+    break;
+  case kADCHuffman: { // Brackets needed to declare variables
+    header.wordcount++;
+    header.mychecksum += word;
+    if( state.currentChannel == 999 ) break; // Not inside a channel
+    // Expand the whole word from the precomputed table straight into the frame buffer
+    size_t nsamples = frame.samples.size();
+    uint16_t last = (nsamples > state.channelBegin) ? frame.samples.back() : 0;
+    frame.samples.resize( nsamples + kHuffmanMaxWrite );
+    int added = expand_huffman( word, last, &frame.samples[nsamples] );
+    if( added < 0 ) added = decode_huffman_word( word, last, &frame.samples[nsamples] ); // Invalid code: report it
+    frame.samples.resize( nsamples + added );
+  } break;
+  case kChannelEnding:
+    header.wordcount++;
+    header.mychecksum += word;
+    if( (word & 0x3F) == state.currentChannel ){
+      frame.channelBegin[state.currentChannel] = state.channelBegin;
+      frame.channelEnd[state.currentChannel] = frame.samples.size();
+      frame.nchannels++;
+      LOG_DEBUG( "Finished reading channel " << state.currentChannel );
+    }
+    else{
+      LOG_ERROR( "ERROR: Channel header " << state.currentChannel << " and ending " << (word & 0x3F) << " do not match" );
+      if( state.currentChannel != 999 ) frame.samples.resize( state.channelBegin );
+    }
+    // Reset
+    state.currentChannel = 999;
+    break;
+  case kUnknown:
+    header.wordcount++;
+    header.mychecksum += word;
+    break;
+  } // end of switch
+  return type;
+}
+
+// Sort channels
+void FrameData::pack(){
+  // Usual case: channels were read in order, each one once, so the buffer is already sorted
+  bool sorted = true;
+  uint32_t position = 0;
+  for(size_t ch = 0; ch < 64 && sorted; ch++){
+    if( channelBegin[ch] == channelEnd[ch] ) continue; // Empty or missing channel
+    sorted = (channelBegin[ch] == position);
+    position = channelEnd[ch];
+  }
+  sorted = sorted && (position == samples.size());
+
+  offsets.resize(65);
+  if( sorted ){
+    offsets[0] = 0;
+    for(size_t ch = 0; ch < 64; ch++){
+      offsets[ch + 1] = offsets[ch] + (channelEnd[ch] - channelBegin[ch]);
+    }
+    return;
+  }
+  std::vector<uint16_t> packed;
+  offsets[0] = 0;
+  for(size_t ch = 0; ch < 64; ch++){
+    packed.insert( packed.end(), samples.begin() + channelBegin[ch], samples.begin() + channelEnd[ch] );
+    offsets[ch + 1] = packed.size();
+  }
+  samples.swap( packed );
+}
+
+// Compare counted and header values
+bool check_frame( HeaderInfo& header ){
+  header.wordcount = (header.wordcount & 0xFFFFFF);
+  int32_t nwords_diff = header.nwords - header.wordcount;
+  if( nwords_diff != 0 ) LOG_WARNING( "WARNING: Word count difference: " << nwords_diff );
+  header.mychecksum = (header.mychecksum & 0xFFFFFF);
+  uint32_t checksum_diff = header.checksum - header.mychecksum;
+  if( checksum_diff != 0 ) LOG_WARNING( "WARNING: Checksum difference: " << checksum_diff );
+  return (nwords_diff == 0) && (checksum_diff == 0);
+}
+
+// Find frame boundaries
+std::vector<FrameSpan> scan_frames( const uint32_t* words, size_t nwords, size_t* nxmit ){
+  std::vector<FrameSpan> spans;
+  int headerCounter = 0; // Same counting as get_word_type
+  for(size_t w = 0; w < nwords; w++){
+    uint32_t word32b = words[w];
+    if( is_xmit_word( word32b ) ){ // Temporary: ignore XMIT words
+      LOG_INFO( "INFO: XMIT word " << std::hex << std::setfill('0') << std::setw(8) << word32b << " found and ignored" );
+      if( nxmit ) (*nxmit)++;
+      continue;
+    }
+    for(size_t i = 0; i < 2; i++){
+      uint16_t word = (word32b >> (16*i)) & 0xFFFF;
+      if( (word & 0xF000) != 0xF000 ) continue;
+      if( headerCounter == 0 ){
+	if( !spans.empty() ) spans.back().end = 2*w + i;
+	spans.push_back( FrameSpan{2*w + i, 2*nwords} );
+      }
+      headerCounter = (headerCounter == 11) ? 0 : headerCounter + 1;
+    }
+  }
+  if( spans.empty() ) spans.push_back( FrameSpan{0, 2*nwords} ); // No header: decode everything as one frame
+  return spans;
+}
+
+// Decode one frame
+void decode_frame( const uint32_t* words, const FrameSpan& span, FrameData& frame ){
+  DecoderState state;
+  frame.clear();
+  for(size_t w = span.begin/2; w < (span.end + 1)/2; w++){
+    uint32_t word32b = words[w];
+    if( is_xmit_word( word32b ) ) continue;
+    for(size_t i = 0; i < 2; i++){
+      size_t k = 2*w + i;
+      if( k < span.begin || k >= span.end ) continue;
+      decode_word( (word32b >> (16*i)) & 0xFFFF, state, frame );
+    }
+  }
+  frame.pack();
+}
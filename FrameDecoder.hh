@@ -0,0 +1,109 @@
+#ifndef FRAMEDECODER_HH
+#define FRAMEDECODER_HH
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include "decoder.hh"
+#include "HeaderInfo.hh"
+
+// XMIT words are not part of the FEM data
+inline bool is_xmit_word( uint32_t word32b ){
+  return (word32b == 0xFFFFFFFF) || (word32b == 0xE0000000);
+}
+
+// True if the word would be classified as kHeaderFirst (without changing the state)
+inline bool is_frame_start( uint16_t word, const DecoderState& state ){
+  return ((word & 0xF000) == 0xF000) && (state.headerCounter == 0);
+}
+
+// Decoded content of one FEM frame (one entry of decoderTree)
+// The samples of all channels share one buffer: channel ch is samples[offsets[ch], offsets[ch+1])
+struct FrameData{
+  HeaderInfo header;
+  std::vector<uint16_t> samples; // Samples of the 64 channels, channel after channel
+  std::vector<uint32_t> offsets; // 65 entries, filled by pack()
+  uint32_t nchannels = 0; // Channels read with matching header and ending
+
+  // Range of each channel in "samples" while the frame is being decoded
+  uint32_t channelBegin[64];
+  uint32_t channelEnd[64];
+
+  FrameData(){ clear(); };
+
+  void clear(){ // Reset header and waveforms, keeping the allocated memory
+    header.clear();
+    samples.clear();
+    offsets.assign(65, 0);
+    nchannels = 0;
+    for(size_t ch = 0; ch < 64; ch++){
+      channelBegin[ch] = 0;
+      channelEnd[ch] = 0;
+    }
+  };
+
+  // Put the channels in order in "samples" and fill "offsets"
+  // Only copies when channels were read out of order, repeated or left incomplete
+  void pack();
+
+  size_t size( size_t ch ) const { return offsets[ch + 1] - offsets[ch]; }; // Number of samples in channel
+  const uint16_t* channel( size_t ch ) const { return samples.data() + offsets[ch]; }; // First sample of channel
+};
+
+// Counters reported at the end of a run
+struct RunSummary{
+  size_t frames = 0;
+  size_t channels = 0;
+  size_t wordCountMismatches = 0;
+  size_t checksumMismatches = 0;
+  size_t xmitWords = 0; // XMIT words skipped
+  size_t inputBytes = 0; // Bytes of the binary file read
+  double seconds = 0.; // Decoding time, outputs included
+
+  void add_frame( const FrameData& frame ){ // After check_frame
+    frames++;
+    channels += frame.nchannels;
+    if( frame.header.nwords != frame.header.wordcount ) wordCountMismatches++;
+    if( frame.header.checksum != frame.header.mychecksum ) checksumMismatches++;
+  };
+
+  void add_run( const RunSummary& run ){ // Totals of several files
+    frames += run.frames;
+    channels += run.channels;
+    wordCountMismatches += run.wordCountMismatches;
+    checksumMismatches += run.checksumMismatches;
+    xmitWords += run.xmitWords;
+    inputBytes += run.inputBytes;
+    seconds += run.seconds;
+  };
+};
+
+// Range [begin, end) of 16-bit words holding one FEM frame
+// 16-bit word k is the lower (k even) or upper (k odd) half of 32-bit word k/2
+struct FrameSpan{
+  size_t begin;
+  size_t end;
+};
+
+// Fill the header field held by a header word of the given type (kHeaderIDSlot to kHeaderSampleLSB)
+void decode_header_word( WordType type, uint16_t word, HeaderInfo& header );
+
+// Interpret one 16-bit word and add it to the frame
+// kHeaderFirst clears the frame and the channel being read
+WordType decode_word( uint16_t word, DecoderState& state, FrameData& frame );
+
+// Compare the counted number of words and checksum with the header values. Returns false on mismatch
+bool check_frame( HeaderInfo& header );
+
+// Find the FEM frames in a span of 32-bit words (every 12th 0xF... word starts a frame)
+// Words before the first frame are dropped, like the serial decoder does
+// If there is no frame header at all, the whole span is returned as a single frame
+// The number of XMIT words skipped is added to "nxmit" if given
+std::vector<FrameSpan> scan_frames( const uint32_t* words, size_t nwords, size_t* nxmit = nullptr );
+
+// Decode one frame found by scan_frames, independently of the rest of the file
+// The frame is packed when it is returned
+void decode_frame( const uint32_t* words, const FrameSpan& span, FrameData& frame );
+
+#endif
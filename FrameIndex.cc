@@ -0,0 +1,137 @@
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+
+#include <sys/stat.h>
+
+#include "FrameIndex.hh"
+#include "Verifier.hh"
+#include "Logger.hh"
+
+static_assert( sizeof(FrameIndexHeader) == 40, "FrameIndexHeader layout changed" );
+static_assert( sizeof(FrameIndexRecord) == 56, "FrameIndexRecord layout changed" );
+
+// Size and modification time of a file, false if it does not exist
+static bool file_stamp( const std::string& fileName, uint64_t& size, int64_t& mtime ){
+  struct stat st;
+  if( stat( fileName.c_str(), &st ) != 0 ) return false;
+  size = st.st_size;
+  mtime = st.st_mtime;
+  return true;
+}
+
+void FrameIndex::build( const MappedFile& binFile, unsigned nthreads ){
+  std::vector<FrameSpan> spans = scan_frames( binFile.words(), binFile.nwords() );
+  std::vector<FrameCheck> checks = verify_frames( binFile.words(), spans, nthreads );
+  fRecords.resize( spans.size() );
+  for(size_t i = 0; i < spans.size(); i++){
+    const HeaderInfo& h = checks[i].header;
+    FrameIndexRecord& record = fRecords[i];
+    std::memset( &record, 0, sizeof(record) );
+    record.begin = 2*uint64_t(spans[i].begin);
+    record.end = 2*uint64_t(spans[i].end);
+    record.event = h.event;
+    record.frame = h.frame;
+    record.nwords = h.nwords;
+    record.checksum = h.checksum;
+    record.triggersample = h.triggersample;
+    record.wordcount = h.wordcount;
+    record.mychecksum = h.mychecksum;
+    record.slot = h.slot;
+    record.id = h.id;
+    record.flags = (h.test ? 0x1 : 0) | (h.overflow ? 0x2 : 0) | (h.full ? 0x4 : 0);
+    record.triggerframe = h.triggerframe;
+    record.status = (checks[i].words_ok() ? kIndexWordCountOK : 0) | (checks[i].checksum_ok() ? kIndexChecksumOK : 0);
+  }
+  fill_lookup();
+}
+
+bool FrameIndex::save( const std::string& fileName, const std::string& binFileName ) const {
+  FrameIndexHeader fileHeader;
+  std::memset( &fileHeader, 0, sizeof(fileHeader) );
+  std::memcpy( fileHeader.magic, kIndexMagic, sizeof(kIndexMagic) );
+  fileHeader.version = kIndexVersion;
+  if( !file_stamp( binFileName, fileHeader.fileSize, fileHeader.fileMTime ) ) return false;
+  fileHeader.nframes = fRecords.size();
+
+  FILE* file = fopen( fileName.c_str(), "wb" );
+  if( !file ) return false;
+  bool ok = (fwrite( &fileHeader, sizeof(fileHeader), 1, file ) == 1);
+  ok = ok && (fwrite( fRecords.data(), sizeof(FrameIndexRecord), fRecords.size(), file ) == fRecords.size());
+  ok = (fclose( file ) == 0) && ok;
+  return ok;
+}
+
+bool FrameIndex::load( const std::string& fileName, const std::string& binFileName ){
+  fRecords.clear();
+  fLookup.clear();
+  FILE* file = fopen( fileName.c_str(), "rb" );
+  if( !file ) return false;
+  FrameIndexHeader fileHeader;
+  uint64_t size = 0;
+  int64_t mtime = 0;
+  bool ok = (fread( &fileHeader, sizeof(fileHeader), 1, file ) == 1)
+    && std::memcmp( fileHeader.magic, kIndexMagic, sizeof(kIndexMagic) ) == 0
+    && fileHeader.version == kIndexVersion
+    && file_stamp( binFileName, size, mtime ) && size == fileHeader.fileSize && mtime == fileHeader.fileMTime;
+  if( ok ){
+    fRecords.resize( fileHeader.nframes );
+    ok = (fread( fRecords.data(), sizeof(FrameIndexRecord), fRecords.size(), file ) == fRecords.size());
+  }
+  fclose( file );
+  if( !ok ){
+    fRecords.clear();
+    return false;
+  }
+  fill_lookup();
+  return true;
+}
+
+bool FrameIndex::open( const std::string& binFileName, const MappedFile& binFile, unsigned nthreads ){
+  std::string indexName = sidecar_name( binFileName );
+  if( load( indexName, binFileName ) ){
+    LOG_INFO( "INFO: Read index of " << size() << " frames from " << indexName );
+    return true;
+  }
+  if( !binFile.is_open() ) return false;
+  build( binFile, nthreads );
+  if( save( indexName, binFileName ) ) LOG_INFO( "INFO: Index of " << size() << " frames written to " << indexName );
+  else LOG_WARNING( "WARNING: Could not write index file " << indexName );
+  return true;
+}
+
+HeaderInfo FrameIndex::header( size_t i ) const {
+  const FrameIndexRecord& record = fRecords[i];
+  HeaderInfo header;
+  header.id = record.id;
+  header.slot = record.slot;
+  header.test = (record.flags & 0x1);
+  header.overflow = (record.flags & 0x2);
+  header.full = (record.flags & 0x4);
+  header.triggerframe = record.triggerframe;
+  header.nwords = record.nwords;
+  header.event = record.event;
+  header.frame = record.frame;
+  header.checksum = record.checksum;
+  header.triggersample = record.triggersample;
+  header.wordcount = record.wordcount;
+  header.mychecksum = record.mychecksum;
+  return header;
+}
+
+long FrameIndex::find( uint32_t event, uint8_t slot ) const {
+  std::unordered_map<uint64_t, size_t>::const_iterator it = fLookup.find( (uint64_t(event) << 8) | slot );
+  return (it == fLookup.end()) ? -1 : (long)it->second;
+}
+
+std::string FrameIndex::sidecar_name( const std::string& binFileName ){
+  return binFileName.substr(0, binFileName.find_last_of(".")) + ".idx";
+}
+
+void FrameIndex::fill_lookup(){
+  fLookup.clear();
+  fLookup.reserve( fRecords.size() );
+  for(size_t i = 0; i < fRecords.size(); i++){
+    fLookup.emplace( (uint64_t(fRecords[i].event) << 8) | fRecords[i].slot, i ); // Keeps the first frame if repeated
+  }
+}
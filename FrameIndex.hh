@@ -0,0 +1,86 @@
+#ifndef FRAMEINDEX_HH
+#define FRAMEINDEX_HH
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "HeaderInfo.hh"
+#include "FrameDecoder.hh"
+#include "MappedFile.hh"
+
+// Index of the FEM frames of a binary file, saved next to it as a sidecar file (run.dat -> run.idx)
+// It is built from the header words and a word count/checksum pass (see Verifier.hh), without decoding samples,
+// so one frame can be decoded straight from its position in the memory-mapped file
+//
+//   FrameIndexHeader                      (40 bytes)
+//   FrameIndexRecord x nframes            (56 bytes each, in file order)
+//
+// All values are little-endian
+
+const char kIndexMagic[8] = {'N', 'E', 'V', 'I', 'S', 'I', 'D', 'X'};
+const uint32_t kIndexVersion = 2; // Older index files are rebuilt
+
+struct FrameIndexHeader{
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+  uint64_t fileSize; // Size and modification time of the binary file, to detect a stale index
+  int64_t fileMTime;
+  uint64_t nframes;
+};
+
+// Status bits of a frame
+const uint8_t kIndexWordCountOK = 0x1;
+const uint8_t kIndexChecksumOK = 0x2;
+
+// All the values of HeaderInfo, with the counted word count and checksum
+struct FrameIndexRecord{
+  uint64_t begin; // Byte position of the first header word in the binary file
+  uint64_t end; // Byte position after the last word of the frame
+  uint32_t event;
+  uint32_t frame;
+  uint32_t nwords;
+  uint32_t checksum;
+  uint32_t triggersample;
+  uint32_t wordcount;
+  uint32_t mychecksum;
+  uint8_t slot;
+  uint8_t id;
+  uint8_t status; // kIndexWordCountOK | kIndexChecksumOK when the frame is valid
+  uint8_t flags; // Bit 0: test, bit 1: overflow, bit 2: full
+  uint8_t triggerframe;
+  uint8_t reserved[7];
+};
+
+class FrameIndex{
+public:
+  // Scan the binary file and fill the index
+  void build( const MappedFile& binFile, unsigned nthreads = 1 );
+  bool save( const std::string& fileName, const std::string& binFileName ) const;
+  // Returns false if the index file is missing, damaged or does not match the binary file
+  bool load( const std::string& fileName, const std::string& binFileName );
+  // Load the sidecar of a binary file, or build and save it if it is missing or stale
+  bool open( const std::string& binFileName, const MappedFile& binFile, unsigned nthreads = 1 );
+
+  size_t size() const { return fRecords.size(); };
+  const FrameIndexRecord& record( size_t i ) const { return fRecords[i]; };
+  FrameSpan span( size_t i ) const { return FrameSpan{ fRecords[i].begin/2, fRecords[i].end/2 }; };
+  bool ok( size_t i ) const { return fRecords[i].status == (kIndexWordCountOK | kIndexChecksumOK); };
+  HeaderInfo header( size_t i ) const;
+
+  // Index of the frame of FEM "slot" in "event", or -1 if there is none
+  long find( uint32_t event, uint8_t slot ) const;
+
+  static std::string sidecar_name( const std::string& binFileName );
+
+private:
+  void fill_lookup();
+
+  std::vector<FrameIndexRecord> fRecords;
+  std::unordered_map<uint64_t, size_t> fLookup; // (event, slot) -> frame
+};
+
+#endif
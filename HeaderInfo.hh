@@ -1,3 +1,8 @@
+#ifndef HEADERINFO_HH
+#define HEADERINFO_HH
+
+#include <cstdint>
+
 // Class for header information
 class HeaderInfo{
 public:
@@ -33,3 +38,5 @@ public:
     mychecksum = 0;
   };
 };
+
+#endif
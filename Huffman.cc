@@ -0,0 +1,110 @@
+#include <iostream>
+
+#include "Huffman.hh"
+#include "Logger.hh"
+
+// Decode Huffman
+int decode_huffman( int zeros ){
+  switch( zeros ){
+  case 0: return 0;
+  case 1: return -1;
+  case 2: return 1;
+  case 3: return -2;
+  case 4: return 2;
+  case 5: return -3;
+  case 6: return 3;
+  default:
+    LOG_ERROR( "ERROR: Number of zeros (" << zeros << ") in Huffman word is out of bounds" );
+    return 4096;
+  }
+}
+
+// Decode Huffman word bit by bit
+int decode_huffman_word( uint16_t word, uint16_t last, uint16_t* out ){
+  int zeros = 0; // Counter of 0s interleaved between 1s
+  int differences[14]; // Huffman-decoded differences (at most one per bit)
+  int ndifferences = 0;
+  // Read the lowest 14 bits from left to right
+  for(uint16_t mask = 0x2000; mask > 0x0; mask = (mask>>1)){
+    if( (word & mask) == mask ){ // Found 1
+      differences[ndifferences++] = decode_huffman(zeros);
+      zeros = 0; // Reset counter
+    } else zeros++;
+  }
+  // Differences are time-ordered from right to left
+  for(int i = ndifferences; i > 0; i--){
+    last = static_cast<uint16_t>( last + differences[i - 1] );
+    *out++ = last;
+  }
+  return ndifferences;
+}
+
+// Build the expansion of every 14-bit payload
+static const HuffmanEntry* build_huffman_table(){
+  alignas(16) static HuffmanEntry table[1 << 14];
+  for(int payload = 0; payload < (1 << 14); payload++){
+    HuffmanEntry& entry = table[payload];
+    int zeros = 0;
+    int differences[14];
+    int ndifferences = 0;
+    bool valid = true;
+    for(int mask = 0x2000; mask > 0x0; mask = (mask>>1)){
+      if( (payload & mask) == mask ){
+	if( zeros > 6 ) valid = false; // decode_huffman would complain
+	else differences[ndifferences++] = decode_huffman(zeros);
+	zeros = 0;
+      } else zeros++;
+    }
+    int sum = 0;
+    for(int i = 0; i < 15; i++){
+      if( i < ndifferences ) sum += differences[ndifferences - 1 - i];
+      entry.offset[i] = (i < ndifferences) ? sum : 0;
+    }
+    entry.count = valid ? ndifferences : kHuffmanInvalid;
+  }
+  return table;
+}
+
+const HuffmanEntry* const gHuffmanTable = build_huffman_table();
+
+// Check the table against the bit-by-bit decoding
+bool check_huffman_table(){
+  const uint16_t lasts[] = {0, 1, 3, 2048, 4093, 4095, 65533, 65535}; // Include values that wrap around
+  int nerrors = 0;
+  int ninvalid = 0;
+  for(int payload = 0; payload < (1 << 14); payload++){
+    uint16_t word = 0x8000 | payload;
+    // Payloads with more than 6 zeros before a 1 must be flagged as invalid
+    bool valid = true;
+    int zeros = 0;
+    for(int mask = 0x2000; mask > 0x0; mask = (mask>>1)){
+      if( (payload & mask) == mask ){
+	if( zeros > 6 ) valid = false;
+	zeros = 0;
+      } else zeros++;
+    }
+    uint16_t dummy[kHuffmanMaxWrite];
+    if( !valid ){
+      ninvalid++;
+      if( expand_huffman( word, 0, dummy ) != -1 ){
+	std::cerr << "ERROR: Huffman payload " << payload << " should be invalid" << std::endl;
+	nerrors++;
+      }
+      continue;
+    }
+    for(uint16_t last : lasts){
+      uint16_t reference[14];
+      uint16_t samples[kHuffmanMaxWrite];
+      int nreference = decode_huffman_word( word, last, reference );
+      int nsamples = expand_huffman( word, last, samples );
+      bool same = (nreference == nsamples);
+      for(int i = 0; same && i < nsamples; i++) same = (reference[i] == samples[i]);
+      if( !same ){
+	std::cerr << "ERROR: Huffman payload " << payload << " after sample " << last << " is not decoded bit-exactly" << std::endl;
+	nerrors++;
+      }
+    }
+  }
+  std::cout << "INFO: Checked " << (1 << 14) << " Huffman payloads (" << ninvalid << " invalid): " << nerrors << " mismatches" << std::endl;
+  return nerrors == 0;
+}
@@ -0,0 +1,59 @@
+#ifndef HUFFMAN_HH
+#define HUFFMAN_HH
+
+#include <cstdint>
+
+#include "decoder.hh"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Expansion of the 14-bit payload of a kADCHuffman word
+// Differences are stored already summed up in time order, so sample i is last + offset[i]
+struct HuffmanEntry{
+  int8_t offset[15]; // Cumulative differences (at most 14 samples, |offset| <= 42)
+  uint8_t count; // Number of samples, or kHuffmanInvalid if a code is out of bounds
+};
+
+const uint8_t kHuffmanInvalid = 0xFF;
+const int kHuffmanMaxWrite = 16; // Samples written by expand_huffman, including the unused tail
+
+// Table with one entry per payload, built once when the program starts
+extern const HuffmanEntry* const gHuffmanTable;
+
+// Decode a kADCHuffman word bit by bit (reference implementation)
+// Writes at most 14 samples to "out" and returns how many were written
+int decode_huffman_word( uint16_t word, uint16_t last, uint16_t* out );
+
+// Decode a kADCHuffman word from the table. "out" must have room for kHuffmanMaxWrite samples
+// Returns the number of samples, or -1 if the word holds an invalid code (use decode_huffman_word then)
+inline int expand_huffman( uint16_t word, uint16_t last, uint16_t* out ){
+  const HuffmanEntry& entry = gHuffmanTable[word & 0x3FFF];
+  if( entry.count == kHuffmanInvalid ) return -1;
+#if defined(__AVX2__)
+  __m128i offsets = _mm_loadu_si128( reinterpret_cast<const __m128i*>(&entry) );
+  __m256i samples = _mm256_add_epi16( _mm256_cvtepi8_epi16(offsets), _mm256_set1_epi16(last) );
+  _mm256_storeu_si256( reinterpret_cast<__m256i*>(out), samples );
+#elif defined(__SSE2__)
+  __m128i offsets = _mm_loadu_si128( reinterpret_cast<const __m128i*>(&entry) );
+  // Sign-extend the 8-bit offsets to 16 bits: duplicate each byte, then shift right arithmetically
+  __m128i low = _mm_srai_epi16( _mm_unpacklo_epi8(offsets, offsets), 8 );
+  __m128i high = _mm_srai_epi16( _mm_unpackhi_epi8(offsets, offsets), 8 );
+  __m128i base = _mm_set1_epi16( last );
+  _mm_storeu_si128( reinterpret_cast<__m128i*>(out), _mm_add_epi16(low, base) );
+  _mm_storeu_si128( reinterpret_cast<__m128i*>(out + 8), _mm_add_epi16(high, base) );
+#else
+  for(int i = 0; i < entry.count; i++){
+    out[i] = static_cast<uint16_t>( last + entry.offset[i] );
+  }
+#endif
+  return entry.count;
+}
+
+// Compare the table against decode_huffman_word for every payload. Returns true if they agree
+bool check_huffman_table();
+
+#endif
@@ -1,4 +1,5 @@
 #ifdef __MAKECINT__
 #pragma link C++ class HeaderInfo+;
+#pragma link C++ class vector<HeaderInfo>+;
 #pragma link C++ class vector< vector<uint16_t> >+;
 #endif
@@ -0,0 +1,73 @@
+#include <iostream>
+#include <sstream>
+#include <atomic>
+#include <mutex>
+
+#include "Logger.hh"
+
+static std::atomic<int> gLogLevel(kInfo);
+static std::mutex gOutputMutex; // Only taken when a buffer is written out
+
+// Per-thread buffer: formatting a message never locks, writing out a full buffer does
+class LogBuffer : public std::streambuf{
+public:
+  LogBuffer(){ setp( fData, fData + sizeof(fData) ); };
+  ~LogBuffer(){ sync(); };
+
+protected:
+  int overflow( int c ) override {
+    sync();
+    if( c != traits_type::eof() ){
+      *pptr() = traits_type::to_char_type(c);
+      pbump(1);
+    }
+    return traits_type::not_eof(c);
+  };
+  int sync() override {
+    if( pptr() == pbase() ) return 0;
+    std::lock_guard<std::mutex> lock(gOutputMutex);
+    std::cout.write( pbase(), pptr() - pbase() );
+    std::cout.flush();
+    setp( fData, fData + sizeof(fData) );
+    return 0;
+  };
+
+private:
+  char fData[1 << 16];
+};
+
+static thread_local LogBuffer tBuffer;
+static thread_local std::ostream tBufferStream( &tBuffer );
+static thread_local std::ostringstream tErrorStream;
+
+void set_log_level( LogLevel level ){
+  gLogLevel = level;
+}
+
+LogLevel log_level(){
+  return static_cast<LogLevel>( gLogLevel.load(std::memory_order_relaxed) );
+}
+
+std::ostream& log_begin( LogLevel level ){
+  std::ostream& stream = (level >= kWarning) ? static_cast<std::ostream&>(tErrorStream) : tBufferStream;
+  if( level >= kWarning ) tErrorStream.str("");
+  // Formatting set by the previous message (e.g. std::hex) does not carry over
+  stream.flags( std::ios_base::dec | std::ios_base::skipws );
+  stream.fill(' ');
+  return stream;
+}
+
+void log_end( LogLevel level ){
+  if( level >= kWarning ){
+    tBuffer.pubsync(); // Keep the order of the messages of this thread
+    tErrorStream << '\n';
+    std::lock_guard<std::mutex> lock(gOutputMutex);
+    std::cerr << tErrorStream.str();
+    std::cerr.flush();
+  }
+  else tBufferStream << '\n';
+}
+
+void log_flush(){
+  tBuffer.pubsync();
+}
@@ -0,0 +1,36 @@
+#ifndef LOGGER_HH
+#define LOGGER_HH
+
+#include <ostream>
+
+// Message levels, from most to least verbose
+enum LogLevel{
+  kDebug = 0,
+  kInfo,
+  kWarning,
+  kError
+};
+
+// Messages below this level are not formatted at all
+void set_log_level( LogLevel level );
+LogLevel log_level();
+
+// Debug and info messages go to a buffer owned by the calling thread and reach std::cout in large blocks
+// Warnings and errors go to std::cerr right away (after the pending messages of the thread)
+std::ostream& log_begin( LogLevel level );
+void log_end( LogLevel level );
+void log_flush(); // Write the pending messages of the calling thread
+
+#define LOG_AT( level, message ) \
+  do{ if( (level) >= log_level() ){ log_begin(level) << message; log_end(level); } }while(0)
+#define LOG_INFO( message ) LOG_AT( kInfo, message )
+#define LOG_WARNING( message ) LOG_AT( kWarning, message )
+#define LOG_ERROR( message ) LOG_AT( kError, message )
+// Per-channel and per-word messages only exist when compiled with -DDECODER_DEBUG
+#ifdef DECODER_DEBUG
+#define LOG_DEBUG( message ) LOG_AT( kDebug, message )
+#else
+#define LOG_DEBUG( message ) do{}while(0)
+#endif
+
+#endif
@@ -0,0 +1,81 @@
+#include <iostream>
+#include <cstdlib>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "MappedFile.hh"
+
+bool MappedFile::open( const std::string& fileName ){
+  close();
+  int fd = ::open( fileName.c_str(), O_RDONLY );
+  if( fd < 0 ) return false;
+
+  struct stat st;
+  if( fstat( fd, &st ) != 0 ){
+    ::close( fd );
+    return false;
+  }
+  fSize = st.st_size;
+  if( fSize % sizeof(uint32_t) != 0 ){
+    std::cerr << "WARNING: File size is not a multiple of 4 bytes. The last " << fSize % sizeof(uint32_t) << " bytes are ignored" << std::endl;
+  }
+  if( fSize == 0 ){ // Nothing to map
+    ::close( fd );
+    fOpen = true;
+    return true;
+  }
+
+  void* map = mmap( nullptr, fSize, PROT_READ, MAP_PRIVATE, fd, 0 );
+  if( map != MAP_FAILED ){
+    fMap = map;
+    fData = static_cast<const uint32_t*>(map);
+    madvise( fMap, fSize, MADV_SEQUENTIAL ); // The decoder reads the file front to back
+    fOpen = true;
+  }
+  else fOpen = read_blocks( fd );
+  ::close( fd ); // The mapping stays valid after closing the descriptor
+  if( !fOpen ) close();
+  return fOpen;
+}
+
+void MappedFile::set_random_access(){
+  if( fMap ) madvise( fMap, fSize, MADV_RANDOM );
+}
+
+bool MappedFile::read_blocks( int fd ){
+  // Round up to a whole number of pages so the buffer can be read with aligned block requests
+  size_t pageSize = sysconf( _SC_PAGESIZE );
+  size_t bufferSize = ((fSize + pageSize - 1)/pageSize)*pageSize;
+  if( posix_memalign( &fBuffer, pageSize, bufferSize ) != 0 ){
+    fBuffer = nullptr;
+    return false;
+  }
+  char* dest = static_cast<char*>(fBuffer);
+  size_t done = 0;
+  while( done < fSize ){
+    size_t request = (fSize - done < kBlockSize) ? (fSize - done) : kBlockSize;
+    ssize_t got = ::read( fd, dest + done, request );
+    if( got < 0 && errno == EINTR ) continue;
+    if( got <= 0 ){
+      std::cerr << "ERROR: Short read after " << done << " of " << fSize << " bytes" << std::endl;
+      return false;
+    }
+    done += got;
+  }
+  fData = static_cast<const uint32_t*>(fBuffer);
+  return true;
+}
+
+void MappedFile::close(){
+  if( fMap ) munmap( fMap, fSize );
+  free( fBuffer );
+  fMap = nullptr;
+  fBuffer = nullptr;
+  fData = nullptr;
+  fSize = 0;
+  fOpen = false;
+}
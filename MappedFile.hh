@@ -0,0 +1,39 @@
+#ifndef MAPPEDFILE_HH
+#define MAPPEDFILE_HH
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+// Read-only view of a binary file as one contiguous span of 32-bit words
+// The file is memory-mapped when possible. Otherwise it is read in large aligned blocks
+class MappedFile{
+public:
+  MappedFile() = default;
+  ~MappedFile(){ close(); };
+  MappedFile( const MappedFile& ) = delete;
+  MappedFile& operator=( const MappedFile& ) = delete;
+
+  bool open( const std::string& fileName ); // Returns false if the file cannot be opened or read
+  void close();
+
+  bool is_open() const { return fOpen; };
+  bool is_mapped() const { return fMap != nullptr; };
+  const uint32_t* words() const { return fData; }; // First 32-bit word
+  size_t nwords() const { return fSize/sizeof(uint32_t); }; // Number of complete 32-bit words
+  size_t size() const { return fSize; }; // File size in bytes
+  void set_random_access(); // Tell the kernel not to read ahead (e.g. to decode single frames through an index)
+
+  static const size_t kBlockSize = 8 << 20; // Bytes per read() when mmap is not available
+
+private:
+  bool read_blocks( int fd ); // Fallback when mmap fails
+
+  bool fOpen = false;
+  const uint32_t* fData = nullptr;
+  size_t fSize = 0;
+  void* fMap = nullptr; // mmap'ed region (nullptr if the file was read into fBuffer)
+  void* fBuffer = nullptr; // Aligned buffer used by the fallback
+};
+
+#endif
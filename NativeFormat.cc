@@ -0,0 +1,121 @@
+#include <iostream>
+#include <cstring>
+
+#include "NativeFormat.hh"
+
+static_assert( sizeof(NativeFileHeader) == 32, "NativeFileHeader layout changed" );
+static_assert( sizeof(NativeFrameRecord) == 304, "NativeFrameRecord layout changed" );
+static_assert( sizeof(NativeFileTrailer) == 24, "NativeFileTrailer layout changed" );
+
+void fill_record( NativeFrameRecord& record, const HeaderInfo& header ){
+  record.id = header.id;
+  record.slot = header.slot;
+  record.flags = (header.test ? 0x1 : 0) | (header.overflow ? 0x2 : 0) | (header.full ? 0x4 : 0);
+  record.triggerframe = header.triggerframe;
+  record.nwords = header.nwords;
+  record.event = header.event;
+  record.frame = header.frame;
+  record.checksum = header.checksum;
+  record.triggersample = header.triggersample;
+  record.wordcount = header.wordcount;
+  record.mychecksum = header.mychecksum;
+}
+
+HeaderInfo record_header( const NativeFrameRecord& record ){
+  HeaderInfo header;
+  header.id = record.id;
+  header.slot = record.slot;
+  header.test = (record.flags & 0x1);
+  header.overflow = (record.flags & 0x2);
+  header.full = (record.flags & 0x4);
+  header.triggerframe = record.triggerframe;
+  header.nwords = record.nwords;
+  header.event = record.event;
+  header.frame = record.frame;
+  header.checksum = record.checksum;
+  header.triggersample = record.triggersample;
+  header.wordcount = record.wordcount;
+  header.mychecksum = record.mychecksum;
+  return header;
+}
+
+bool NativeWriter::open( const std::string& fileName ){
+  close();
+  fFile = fopen( fileName.c_str(), "wb" );
+  if( !fFile ) return false;
+  NativeFileHeader fileHeader;
+  std::memset( &fileHeader, 0, sizeof(fileHeader) );
+  std::memcpy( fileHeader.magic, kNativeMagic, sizeof(kNativeMagic) );
+  fileHeader.version = kNativeVersion;
+  fOk = (fwrite( &fileHeader, sizeof(fileHeader), 1, fFile ) == 1);
+  fNSamples = 0;
+  fRecords.clear();
+  return true;
+}
+
+bool NativeWriter::write( const HeaderInfo& header, const std::vector<uint16_t>& samples, const std::vector<uint32_t>& offsets ){
+  if( !fFile || !fOk ) return false;
+  NativeFrameRecord record;
+  std::memset( &record, 0, sizeof(record) );
+  fill_record( record, header );
+  record.sampleOffset = fNSamples;
+  for(size_t ch = 0; ch < 65 && ch < offsets.size(); ch++) record.offsets[ch] = offsets[ch];
+  fRecords.push_back( record );
+  fOk = (fwrite( samples.data(), sizeof(uint16_t), samples.size(), fFile ) == samples.size());
+  fNSamples += samples.size();
+  return fOk;
+}
+
+bool NativeWriter::close(){
+  if( !fFile ) return fOk;
+  // Pad the blob so the frame table is 8-byte aligned
+  const uint16_t zero[3] = {0, 0, 0};
+  const size_t npad = (4 - fNSamples % 4) % 4;
+  bool ok = fOk && (fwrite( zero, sizeof(uint16_t), npad, fFile ) == npad);
+  NativeFileTrailer trailer;
+  trailer.tableOffset = sizeof(NativeFileHeader) + ((fNSamples + 3)/4)*4*sizeof(uint16_t);
+  trailer.nframes = fRecords.size();
+  std::memcpy( trailer.magic, kNativeMagic, sizeof(kNativeMagic) );
+  ok = ok && (fwrite( fRecords.data(), sizeof(NativeFrameRecord), fRecords.size(), fFile ) == fRecords.size());
+  ok = ok && (fwrite( &trailer, sizeof(trailer), 1, fFile ) == 1);
+  ok = (fclose( fFile ) == 0) && ok;
+  fFile = nullptr;
+  fRecords.clear();
+  fOk = ok;
+  return ok;
+}
+
+bool NativeReader::open( const std::string& fileName ){
+  fNFrames = 0;
+  fIndex.clear();
+  if( !fFile.open( fileName ) ) return false;
+  const char* bytes = reinterpret_cast<const char*>( fFile.words() );
+  size_t size = fFile.size();
+  if( size < sizeof(NativeFileHeader) + sizeof(NativeFileTrailer) || std::memcmp( bytes, kNativeMagic, sizeof(kNativeMagic) ) != 0 ){
+    std::cerr << "ERROR: " << fileName << " is not a native decoder file" << std::endl;
+    return false;
+  }
+  const NativeFileHeader* fileHeader = reinterpret_cast<const NativeFileHeader*>( bytes );
+  if( fileHeader->version != kNativeVersion ){
+    std::cerr << "ERROR: Unsupported native file version " << fileHeader->version << std::endl;
+    return false;
+  }
+  const NativeFileTrailer* trailer = reinterpret_cast<const NativeFileTrailer*>( bytes + size - sizeof(NativeFileTrailer) );
+  if( std::memcmp( trailer->magic, kNativeMagic, sizeof(kNativeMagic) ) != 0 ||
+      trailer->tableOffset + trailer->nframes*sizeof(NativeFrameRecord) + sizeof(NativeFileTrailer) != size ){
+    std::cerr << "ERROR: " << fileName << " is incomplete (was the decoder stopped?)" << std::endl;
+    return false;
+  }
+  fSamples = reinterpret_cast<const uint16_t*>( bytes + sizeof(NativeFileHeader) );
+  fTable = reinterpret_cast<const NativeFrameRecord*>( bytes + trailer->tableOffset );
+  fNFrames = trailer->nframes;
+  for(size_t i = 0; i < fNFrames; i++){
+    fIndex.emplace( (uint64_t(fTable[i].event) << 8) | fTable[i].slot, i ); // Keeps the first frame if repeated
+  }
+  return true;
+}
+
+long NativeReader::find( uint32_t event, uint8_t slot ) const {
+  std::unordered_map<uint64_t, size_t>::const_iterator it = fIndex.find( (uint64_t(event) << 8) | slot );
+  return (it == fIndex.end()) ? -1 : (long)it->second;
+}
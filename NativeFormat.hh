@@ -0,0 +1,100 @@
+#ifndef NATIVEFORMAT_HH
+#define NATIVEFORMAT_HH
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "HeaderInfo.hh"
+#include "MappedFile.hh"
+
+// Native output format: the decoded frames in a fixed layout that can be memory-mapped and read without deserialization
+//
+//   NativeFileHeader                      (32 bytes)
+//   Sample blob                           (uint16_t samples of all frames, frame after frame, padded to 8 bytes)
+//   NativeFrameRecord x nframes           (frame table)
+//   NativeFileTrailer                     (24 bytes)
+//
+// All values are little-endian. Frames keep the decoding order (one record per entry of decoderTree)
+
+const char kNativeMagic[8] = {'N', 'E', 'V', 'I', 'S', 'T', 'P', 'C'};
+const uint32_t kNativeVersion = 1;
+
+struct NativeFileHeader{
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved[5];
+};
+
+// Fixed-layout copy of HeaderInfo plus the position of the frame samples
+struct NativeFrameRecord{
+  uint8_t id;
+  uint8_t slot;
+  uint8_t flags; // Bit 0: test, bit 1: overflow, bit 2: full
+  uint8_t triggerframe;
+  uint32_t nwords;
+  uint32_t event;
+  uint32_t frame;
+  uint32_t checksum;
+  uint32_t triggersample;
+  uint32_t wordcount;
+  uint32_t mychecksum;
+  uint64_t sampleOffset; // First sample of the frame, counted from the beginning of the blob
+  uint32_t offsets[65]; // Channel ch is [offsets[ch], offsets[ch+1]) from sampleOffset
+  uint32_t padding;
+};
+
+struct NativeFileTrailer{
+  uint64_t tableOffset; // Byte position of the frame table
+  uint64_t nframes;
+  char magic[8];
+};
+
+// Conversions between HeaderInfo and the fixed layout
+void fill_record( NativeFrameRecord& record, const HeaderInfo& header );
+HeaderInfo record_header( const NativeFrameRecord& record );
+
+// Appends frames to a native file. The frame table is written by close()
+// write() and close() return false once any write has failed (e.g. full disk): the file is then incomplete
+class NativeWriter{
+public:
+  ~NativeWriter(){ close(); };
+  bool open( const std::string& fileName );
+  // offsets: 65 entries, channel ch is samples[offsets[ch], offsets[ch+1])
+  bool write( const HeaderInfo& header, const std::vector<uint16_t>& samples, const std::vector<uint32_t>& offsets );
+  bool close();
+
+private:
+  FILE* fFile = nullptr;
+  bool fOk = true; // No write failed since open()
+  uint64_t fNSamples = 0;
+  std::vector<NativeFrameRecord> fRecords;
+};
+
+// Read-only access to a native file through a memory map
+class NativeReader{
+public:
+  bool open( const std::string& fileName );
+
+  size_t nframes() const { return fNFrames; };
+  const NativeFrameRecord& record( size_t i ) const { return fTable[i]; };
+  HeaderInfo header( size_t i ) const { return record_header( fTable[i] ); };
+  size_t size( size_t i, size_t ch ) const { return fTable[i].offsets[ch + 1] - fTable[i].offsets[ch]; };
+  const uint16_t* channel( size_t i, size_t ch ) const { return fSamples + fTable[i].sampleOffset + fTable[i].offsets[ch]; };
+  const uint16_t* samples( size_t i ) const { return fSamples + fTable[i].sampleOffset; };
+
+  // Index of the frame of FEM "slot" in "event", or -1 if there is none
+  long find( uint32_t event, uint8_t slot ) const;
+
+private:
+  MappedFile fFile;
+  const uint16_t* fSamples = nullptr;
+  const NativeFrameRecord* fTable = nullptr;
+  size_t fNFrames = 0;
+  std::unordered_map<uint64_t, size_t> fIndex; // (event, slot) -> frame
+};
+
+#endif
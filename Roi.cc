@@ -0,0 +1,83 @@
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+#include "Roi.hh"
+
+uint16_t median_pedestal( const uint16_t* adc, size_t n, std::vector<uint16_t>& scratch ){
+  if( n == 0 ) return 0;
+  // Median of at most ~256 evenly spaced samples
+  const size_t stride = std::max<size_t>( 1, n/256 );
+  scratch.clear();
+  for(size_t t = 0; t < n; t += stride) scratch.push_back( adc[t] );
+  std::nth_element( scratch.begin(), scratch.begin() + scratch.size()/2, scratch.end() );
+  return scratch[scratch.size()/2];
+}
+
+RoiFinder::RoiFinder( int threshold, int pre, int post )
+  : fThresholds( 32*64, threshold ), fPre(std::max( 0, pre )), fPost(std::max( 0, post )) {}
+
+bool RoiFinder::read_thresholds( const std::string& fileName, std::string& error ){
+  std::ifstream file( fileName );
+  if( !file.is_open() ){
+    error = "could not open " + fileName;
+    return false;
+  }
+  std::string line;
+  for(int n = 1; std::getline( file, line ); n++){
+    line = line.substr( 0, line.find('#') );
+    std::istringstream fields( line );
+    int slot, ch, threshold;
+    if( !(fields >> slot) ) continue; // Empty line
+    if( !(fields >> ch >> threshold) || slot < 0 || slot >= 32 || ch < 0 || ch >= 64 ){
+      std::ostringstream message;
+      message << fileName << ":" << n << ": expected \"slot channel threshold\"";
+      error = message.str();
+      return false;
+    }
+    fThresholds[64*slot + ch] = threshold;
+  }
+  return true;
+}
+
+void RoiFinder::find( const FrameData& frame, RoiFrame& roi, std::vector<uint16_t>& scratch ) const {
+  roi.header = frame.header;
+  roi.pedestals.assign( 64, 0 );
+  roi.sizes.assign( 64, 0 );
+  roi.channels.clear();
+  roi.starts.clear();
+  roi.offsets.assign( 1, 0 );
+  roi.samples.clear();
+  for(size_t ch = 0; ch < 64; ch++){
+    const size_t n = frame.size(ch);
+    roi.sizes[ch] = n;
+    if( n == 0 ) continue;
+    const uint16_t* adc = frame.channel(ch);
+    const int pedestal = median_pedestal( adc, n, scratch );
+    const int threshold = this->threshold( frame.header.slot, ch );
+    roi.pedestals[ch] = pedestal;
+
+    // Windows around the samples over threshold, merged when they overlap or touch
+    long begin = -1, end = -1; // Current window [begin, end)
+    auto store = [&](){
+      roi.channels.push_back( ch );
+      roi.starts.push_back( begin );
+      roi.samples.insert( roi.samples.end(), adc + begin, adc + end );
+      roi.offsets.push_back( roi.samples.size() );
+    };
+    for(size_t t = 0; t < n; t++){
+      int deviation = (int)adc[t] - pedestal;
+      if( deviation <= threshold && deviation >= -threshold ) continue;
+      long from = std::max( 0L, (long)t - fPre );
+      long to = std::min( (long)n, (long)t + fPost + 1 );
+      if( begin >= 0 && from <= end ){
+	end = std::max( end, to );
+	continue;
+      }
+      if( begin >= 0 ) store();
+      begin = from;
+      end = to;
+    }
+    if( begin >= 0 ) store();
+  }
+}
@@ -0,0 +1,53 @@
+#ifndef ROI_HH
+#define ROI_HH
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "HeaderInfo.hh"
+#include "FrameDecoder.hh"
+
+// Zero suppression: only the regions of interest (ROIs) of each channel are kept, i.e. the samples further than a
+// threshold from the pedestal, plus "pre" samples before and "post" samples after. Overlapping regions are merged
+// The pedestal of a waveform is its median (of up to ~256 evenly spaced samples), so it follows the baseline of each
+// channel without a second pass
+
+// ROIs of one frame. ROI r is channel "channels[r]", ticks starts[r] to starts[r] + size(r) - 1,
+// samples[offsets[r], offsets[r+1])
+struct RoiFrame{
+  HeaderInfo header;
+  std::vector<uint16_t> pedestals; // 64 entries
+  std::vector<uint32_t> sizes; // 64 entries: samples of each channel before suppression
+  std::vector<uint8_t> channels;
+  std::vector<uint16_t> starts;
+  std::vector<uint32_t> offsets; // nrois + 1 entries
+  std::vector<uint16_t> samples;
+
+  size_t nrois() const { return channels.size(); };
+  size_t size( size_t r ) const { return offsets[r + 1] - offsets[r]; };
+};
+
+// Pedestal of a waveform of n samples (0 if empty). "scratch" is working memory, reused from call to call
+uint16_t median_pedestal( const uint16_t* adc, size_t n, std::vector<uint16_t>& scratch );
+
+class RoiFinder{
+public:
+  // Same threshold (in ADC counts from the pedestal, either side) for all channels
+  RoiFinder( int threshold = 20, int pre = 8, int post = 8 );
+
+  // Thresholds of some channels, from a text file with lines "slot channel threshold" ('#' starts a comment)
+  bool read_thresholds( const std::string& fileName, std::string& error );
+  int threshold( size_t slot, size_t ch ) const { return fThresholds[64*(slot & 31) + ch]; };
+
+  // ROIs of a packed frame. "scratch" is working memory, reused from call to call
+  void find( const FrameData& frame, RoiFrame& roi, std::vector<uint16_t>& scratch ) const;
+
+private:
+  std::vector<int> fThresholds; // By 64*slot + FEM channel
+  int fPre;
+  int fPost;
+};
+
+#endif
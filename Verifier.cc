@@ -0,0 +1,138 @@
+#include <thread>
+#include <atomic>
+
+#include "Verifier.hh"
+
+// Count one non-header word as decode_word does: ADC words outside a channel (padding) are not data words
+static inline void count_word( uint16_t word, bool& inside, uint32_t& sum, size_t& count ){
+  int nibble = word >> 12;
+  if( nibble == 0x4 ) inside = true; // Channel header
+  else if( nibble == 0x5 ) inside = false; // Channel ending
+  else if( nibble == 0x0 && !inside ) return;
+  sum += word;
+  count++;
+}
+
+// Take out of "sum" and "count" the ADC words outside a channel among 32-bit words already summed by sum_words
+// With SSE2, 16 words at a time: bit masks of the ADC words and of the channel headers and endings,
+// walked only where a channel starts or ends
+static void discount_padding( const uint32_t* words, size_t nwords, bool& inside, uint32_t& sum, size_t& count ){
+  size_t w = 0;
+#if defined(__SSE2__)
+  const __m128i xmitA = _mm_set1_epi32( 0xFFFFFFFF );
+  const __m128i xmitB = _mm_set1_epi32( 0xE0000000 );
+  const __m128i adc = _mm_setzero_si128();
+  const __m128i header = _mm_set1_epi16( 0x4 );
+  const __m128i ending = _mm_set1_epi16( 0x5 );
+  // One bit per 16-bit word, in file order (lower half of each 32-bit word first)
+  auto bits = []( __m128i a, __m128i b ){ return (unsigned)_mm_movemask_epi8( _mm_packs_epi16( a, b ) ); };
+  for(; w + 8 <= nwords; w += 8){
+    __m128i a = _mm_loadu_si128( reinterpret_cast<const __m128i*>(words + w) );
+    __m128i b = _mm_loadu_si128( reinterpret_cast<const __m128i*>(words + w + 4) );
+    unsigned xmit = bits( _mm_or_si128( _mm_cmpeq_epi32(a, xmitA), _mm_cmpeq_epi32(a, xmitB) ),
+			  _mm_or_si128( _mm_cmpeq_epi32(b, xmitA), _mm_cmpeq_epi32(b, xmitB) ) );
+    __m128i na = _mm_srli_epi16( a, 12 );
+    __m128i nb = _mm_srli_epi16( b, 12 );
+    unsigned adcs = bits( _mm_cmpeq_epi16(na, adc), _mm_cmpeq_epi16(nb, adc) ) & ~xmit;
+    unsigned headers = bits( _mm_cmpeq_epi16(na, header), _mm_cmpeq_epi16(nb, header) ) & ~xmit;
+    unsigned endings = bits( _mm_cmpeq_epi16(na, ending), _mm_cmpeq_epi16(nb, ending) ) & ~xmit;
+    unsigned outside = 0; // ADC words outside a channel
+    unsigned from = 0; // First word of the current stretch
+    for(unsigned marks = headers | endings; marks; marks &= marks - 1){
+      unsigned p = __builtin_ctz( marks );
+      if( !inside ) outside |= adcs & ((1u << p) - 1) & ~((1u << from) - 1);
+      inside = (headers >> p) & 1;
+      from = p + 1;
+    }
+    if( !inside ) outside |= adcs & (0xFFFFu & ~((1u << from) - 1));
+    count -= __builtin_popcount( outside );
+    for(; outside; outside &= outside - 1){
+      unsigned p = __builtin_ctz( outside );
+      sum -= (words[w + p/2] >> (16*(p % 2))) & 0xFFFF;
+    }
+  }
+#endif
+  for(; w < nwords; w++){
+    if( is_xmit_word( words[w] ) ) continue;
+    for(int half = 0; half < 2; half++){
+      uint16_t word = (words[w] >> (16*half)) & 0xFFFF;
+      int nibble = word >> 12;
+      if( nibble == 0x4 ) inside = true;
+      else if( nibble == 0x5 ) inside = false;
+      else if( nibble == 0x0 && !inside ){
+	sum -= word;
+	count--;
+      }
+    }
+  }
+}
+
+// Validate one frame
+void verify_frame( const uint32_t* words, const FrameSpan& span, FrameCheck& check ){
+  HeaderInfo& header = check.header;
+  header.clear();
+  check.begin = span.begin;
+  check.xmitWords = 0;
+  uint32_t sum = 0;
+  size_t count = 0; // Non-header 16-bit words, except ADC words outside a channel
+  bool inside = false; // Between a channel header and its ending
+
+  // Header words (and any data word before the 12th) one by one, as the decoder reads them
+  DecoderState state;
+  int nheader = 0;
+  size_t k = span.begin;
+  for(; k < span.end && nheader < 12; k++){
+    uint32_t word32b = words[k/2];
+    if( is_xmit_word( word32b ) ){
+      if( k % 2 == 0 ) check.xmitWords++;
+      k |= 1; // Skip the whole 32-bit word
+      continue;
+    }
+    uint16_t word = (word32b >> (16*(k % 2))) & 0xFFFF;
+    WordType type = get_word_type( word, state );
+    if( type <= kHeaderSampleLSB ){
+      decode_header_word( type, word, header );
+      nheader++;
+    }
+    else count_word( word, inside, sum, count );
+  }
+  // Upper half of a 32-bit word whose lower half was a header word
+  if( k % 2 == 1 && k < span.end && !is_xmit_word( words[k/2] ) ){
+    count_word( words[k/2] >> 16, inside, sum, count );
+    k++;
+  }
+  else if( k % 2 == 1 ) k++;
+
+  // Whole 32-bit words, then the lower half of the last one if the frame ends in the middle of it
+  if( k < span.end ){
+    size_t w = k/2;
+    size_t nwords = span.end/2 - w;
+    size_t nxmit = 0;
+    sum_words( words + w, nwords, sum, nxmit );
+    count += 2*(nwords - nxmit);
+    check.xmitWords += nxmit;
+    discount_padding( words + w, nwords, inside, sum, count );
+    if( span.end % 2 == 1 && !is_xmit_word( words[span.end/2] ) ) count_word( words[span.end/2] & 0xFFFF, inside, sum, count );
+  }
+
+  header.wordcount = count & 0xFFFFFF;
+  header.mychecksum = sum & 0xFFFFFF;
+}
+
+// Validate all frames
+std::vector<FrameCheck> verify_frames( const uint32_t* words, const std::vector<FrameSpan>& spans, unsigned nthreads ){
+  std::vector<FrameCheck> checks( spans.size() );
+  std::atomic<size_t> next(0);
+  auto work = [&](){
+    // Blocks of frames, so threads do not share cache lines of the table
+    const size_t block = 64;
+    for(size_t first = next.fetch_add(block); first < spans.size(); first = next.fetch_add(block)){
+      for(size_t i = first; i < spans.size() && i < first + block; i++) verify_frame( words, spans[i], checks[i] );
+    }
+  };
+  std::vector<std::thread> workers;
+  for(unsigned t = 1; t < nthreads; t++) workers.emplace_back( work );
+  work();
+  for(size_t t = 0; t < workers.size(); t++) workers[t].join();
+  return checks;
+}
@@ -0,0 +1,94 @@
+#ifndef VERIFIER_HH
+#define VERIFIER_HH
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include "HeaderInfo.hh"
+#include "FrameDecoder.hh"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Word count and checksum validation of FEM frames, without decoding the samples
+// The data words are summed up 32-bit word by 32-bit word with SSE2 (AVX2 with -mavx2), XMIT words masked out
+// The result is the same as the counting done by decode_word: every word after the 12 header words is a data word,
+// except ADC words outside a channel (the 0x0000 padding after a channel ending, or stray ones in malformed frames)
+
+// Validation result of one frame
+struct FrameCheck{
+  size_t begin = 0; // First 16-bit word of the frame in the file
+  HeaderInfo header; // Header values, with wordcount and mychecksum counted (24 bits)
+  size_t xmitWords = 0; // XMIT words inside the frame
+
+  bool words_ok() const { return header.nwords == header.wordcount; };
+  bool checksum_ok() const { return header.checksum == header.mychecksum; };
+  bool ok() const { return words_ok() && checksum_ok(); };
+};
+
+// Validate one frame found by scan_frames
+void verify_frame( const uint32_t* words, const FrameSpan& span, FrameCheck& check );
+
+// Validate all the frames on "nthreads" threads. The table keeps the order of the spans
+std::vector<FrameCheck> verify_frames( const uint32_t* words, const std::vector<FrameSpan>& spans, unsigned nthreads = 1 );
+
+// Sum of the two 16-bit halves of each 32-bit word, XMIT words excepted
+// Adds the sum (modulo 2^32) to "sum" and the number of XMIT words to "nxmit"
+inline void sum_words( const uint32_t* words, size_t nwords, uint32_t& sum, size_t& nxmit ){
+  size_t w = 0;
+#if defined(__AVX2__)
+  const __m256i xmitA = _mm256_set1_epi32( 0xFFFFFFFF );
+  const __m256i xmitB = _mm256_set1_epi32( 0xE0000000 );
+  const __m256i lowMask = _mm256_set1_epi32( 0xFFFF );
+  __m256i acc = _mm256_setzero_si256();
+  __m256i xmitAcc = _mm256_setzero_si256();
+  for(; w + 8 <= nwords; w += 8){
+    __m256i v = _mm256_loadu_si256( reinterpret_cast<const __m256i*>(words + w) );
+    __m256i xmit = _mm256_or_si256( _mm256_cmpeq_epi32(v, xmitA), _mm256_cmpeq_epi32(v, xmitB) ); // -1 where XMIT
+    v = _mm256_andnot_si256( xmit, v );
+    acc = _mm256_add_epi32( acc, _mm256_add_epi32( _mm256_and_si256(v, lowMask), _mm256_srli_epi32(v, 16) ) );
+    xmitAcc = _mm256_sub_epi32( xmitAcc, xmit );
+  }
+  uint32_t lanes[8], xmitLanes[8];
+  _mm256_storeu_si256( reinterpret_cast<__m256i*>(lanes), acc );
+  _mm256_storeu_si256( reinterpret_cast<__m256i*>(xmitLanes), xmitAcc );
+  for(size_t i = 0; i < 8; i++){
+    sum += lanes[i];
+    nxmit += xmitLanes[i];
+  }
+#elif defined(__SSE2__)
+  const __m128i xmitA = _mm_set1_epi32( 0xFFFFFFFF );
+  const __m128i xmitB = _mm_set1_epi32( 0xE0000000 );
+  const __m128i lowMask = _mm_set1_epi32( 0xFFFF );
+  __m128i acc = _mm_setzero_si128();
+  __m128i xmitAcc = _mm_setzero_si128();
+  for(; w + 4 <= nwords; w += 4){
+    __m128i v = _mm_loadu_si128( reinterpret_cast<const __m128i*>(words + w) );
+    __m128i xmit = _mm_or_si128( _mm_cmpeq_epi32(v, xmitA), _mm_cmpeq_epi32(v, xmitB) ); // -1 where XMIT
+    v = _mm_andnot_si128( xmit, v );
+    acc = _mm_add_epi32( acc, _mm_add_epi32( _mm_and_si128(v, lowMask), _mm_srli_epi32(v, 16) ) );
+    xmitAcc = _mm_sub_epi32( xmitAcc, xmit );
+  }
+  uint32_t lanes[4], xmitLanes[4];
+  _mm_storeu_si128( reinterpret_cast<__m128i*>(lanes), acc );
+  _mm_storeu_si128( reinterpret_cast<__m128i*>(xmitLanes), xmitAcc );
+  for(size_t i = 0; i < 4; i++){
+    sum += lanes[i];
+    nxmit += xmitLanes[i];
+  }
+#endif
+  for(; w < nwords; w++){
+    uint32_t word32b = words[w];
+    if( is_xmit_word( word32b ) ){
+      nxmit++;
+      continue;
+    }
+    sum += (word32b & 0xFFFF) + (word32b >> 16);
+  }
+}
+
+#endif
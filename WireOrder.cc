@@ -0,0 +1,59 @@
+#include <algorithm>
+#include <cstring>
+
+#include "WireOrder.hh"
+
+bool WireOrder::build( const ChannelMap& channelMap, unsigned firstSlot, unsigned nslots ){
+  fNames.clear();
+  fWires.clear();
+  fChannels.clear();
+  // (wire, crate channel) of each plane
+  std::vector< std::vector< std::pair<int32_t, int32_t> > > rows;
+  for(unsigned s = 0; s < nslots; s++){
+    for(int ch = 0; ch < 64; ch++){
+      const ChannelMapRecord* record = channelMap.find( firstSlot + s, ch );
+      if( !record || record->larWire < 0 ) continue;
+      const std::string& name = channelMap.plane( *record );
+      size_t p = std::find( fNames.begin(), fNames.end(), name ) - fNames.begin();
+      if( p == fNames.size() ){
+	fNames.push_back( name );
+	rows.resize( p + 1 );
+      }
+      rows[p].push_back( std::make_pair( (int32_t)record->larWire, (int32_t)(64*s + ch) ) );
+    }
+  }
+  fWires.resize( rows.size() );
+  fChannels.resize( rows.size() );
+  for(size_t p = 0; p < rows.size(); p++){
+    std::sort( rows[p].begin(), rows[p].end() );
+    for(size_t r = 0; r < rows[p].size(); r++){
+      fWires[p].push_back( rows[p][r].first );
+      fChannels[p].push_back( rows[p][r].second );
+    }
+  }
+  return !fNames.empty();
+}
+
+uint32_t WireOrder::fill( const CrateEvent& event, std::vector< std::vector<uint16_t> >& matrices ) const {
+  const size_t nchannels = event.offsets.empty() ? 0 : event.offsets.size() - 1;
+  uint32_t nsamples = 0;
+  for(size_t p = 0; p < fChannels.size(); p++){
+    for(size_t r = 0; r < fChannels[p].size(); r++){
+      size_t c = fChannels[p][r];
+      if( c < nchannels ) nsamples = std::max( nsamples, event.offsets[c + 1] - event.offsets[c] );
+    }
+  }
+  matrices.resize( fChannels.size() );
+  for(size_t p = 0; p < fChannels.size(); p++){
+    std::vector<uint16_t>& matrix = matrices[p];
+    matrix.resize( fChannels[p].size()*nsamples ); // Every element is written below
+    for(size_t r = 0; r < fChannels[p].size(); r++){
+      size_t c = fChannels[p][r];
+      uint32_t size = (c < nchannels) ? event.offsets[c + 1] - event.offsets[c] : 0;
+      uint16_t* row = matrix.data() + r*nsamples;
+      if( size > 0 ) std::memcpy( row, event.samples.data() + event.offsets[c], size*sizeof(uint16_t) );
+      std::fill( row + size, row + nsamples, 0 );
+    }
+  }
+  return nsamples;
+}
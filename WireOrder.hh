@@ -0,0 +1,35 @@
+#ifndef WIREORDER_HH
+#define WIREORDER_HH
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "ChannelMap.hh"
+#include "EventBuilder.hh"
+
+// Waveforms of a crate event in LArSoft wire order: one wires x samples matrix per plane (Induction, Collection, ...)
+// Row r of plane p holds the wire wires(p)[r] (wires in increasing order), sample t of it is matrix[r*nsamples + t]
+// Channels shorter than the longest one in the event are padded with zeros
+class WireOrder{
+public:
+  // Rows of the wires read by the crate (FEMs in slots firstSlot to firstSlot + nslots - 1)
+  // Returns false if none of its channels is connected to a wire
+  bool build( const ChannelMap& channelMap, unsigned firstSlot, unsigned nslots );
+
+  size_t nplanes() const { return fNames.size(); };
+  const std::string& plane_name( size_t p ) const { return fNames[p]; };
+  const std::vector<int32_t>& wires( size_t p ) const { return fWires[p]; }; // LArSoft wire of each row
+  const std::vector<int32_t>& channels( size_t p ) const { return fChannels[p]; }; // Crate channel of each row
+
+  // Fill "matrices" (one per plane) from the crate channels, and return the number of samples per row
+  uint32_t fill( const CrateEvent& event, std::vector< std::vector<uint16_t> >& matrices ) const;
+
+private:
+  std::vector<std::string> fNames;
+  std::vector< std::vector<int32_t> > fWires;
+  std::vector< std::vector<int32_t> > fChannels; // Crate channel of each row, (slot - firstSlot)*64 + FEM channel
+};
+
+#endif
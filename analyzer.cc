@@ -1,4 +1,11 @@
 #include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
 
 #include <TROOT.h>
 #include <TRint.h>
@@ -8,39 +15,290 @@
 #include <TCanvas.h>
 
 #include "HeaderInfo.hh"
+#include "EventView.hh"
+#include "MappedFile.hh"
+#include "FrameIndex.hh"
 
-int analyzer( const char* runFile ){
+// Header of one entry, as TTree::Show would print it
+static void show_entry( const std::vector<HeaderInfo>& headers, int entry ){
+  if( entry < 0 || entry >= (int)headers.size() ) return;
+  const HeaderInfo& h = headers[entry];
+  std::cout << "======> EVENT:" << entry << "\n"
+	    << " id = " << (int)h.id << ", slot = " << (int)h.slot << ", test = " << h.test << ", overflow = " << h.overflow << ", full = " << h.full << "\n"
+	    << " nwords = " << h.nwords << ", event = " << h.event << ", frame = " << h.frame << ", checksum = " << h.checksum << "\n"
+	    << " triggerframe = " << (int)h.triggerframe << ", triggersample = " << h.triggersample
+	    << ", wordcount = " << h.wordcount << ", mychecksum = " << h.mychecksum << std::endl;
+}
+
+// Headers of entries [begin, end) of decoderTree, read with a file handle of the calling thread
+// Only the header branch is read (the view never touches the waveforms), through a TTreeCache covering the range
+static bool read_header_range( const char* runFile, Long64_t begin, Long64_t end, HeaderInfo* headers ){
+  TFile inFile( runFile, "READ" );
+  TTree *inTree = inFile.IsOpen() ? EventView::find_tree( &inFile ) : nullptr;
+  if( !inTree ) return false;
+  EventView view;
+  if( !view.attach( inTree, EventView::kSequential, begin, end ) ) return false;
+  for(Long64_t i = begin; i < end; i++){
+    view.set_entry(i);
+    headers[i - begin] = view.header();
+  }
+  view.detach();
+  return true;
+}
+
+// Headers of all the entries of a decoded file (read by "nthreads" threads),
+// or of all the frames of a binary file (read from its index)
+static bool read_headers( const char* runFile, std::vector<HeaderInfo>& headers, unsigned nthreads ){
+  std::string inFileName(runFile);
+  if( inFileName.substr( inFileName.find_last_of(".") + 1 ) == "dat" ){
+    MappedFile binFile;
+    FrameIndex index;
+    if( !binFile.open( inFileName ) || !index.open( inFileName, binFile, nthreads ) ){
+      std::cerr << "Unable to open file: " << runFile << std::endl;
+      return false;
+    }
+    std::cout << "Opening file: " << runFile << " (frame index)" << std::endl;
+    headers.resize( index.size() );
+    for(size_t i = 0; i < index.size(); i++) headers[i] = index.header(i);
+    return true;
+  }
+
+  // Input ROOT file
+  Long64_t entries = 0;
+  {
+    TFile inFile( runFile, "READ" );
+    if( !inFile.IsOpen() ){
+      std::cerr << "Unable to open file: " << runFile << std::endl;
+      return false;
+    }
+    else std::cout << "Opening file: " << runFile << std::endl;
+
+    // Get the input tree (decoderTree, or roiTree of a zero-suppressed file)
+    TTree *inTree = EventView::find_tree( &inFile );
+    if( !inTree ){
+      std::cerr << "Tree not found: decoderTree or roiTree" << std::endl;
+      return false;
+    }
+    else std::cout << "Tree found: " << inTree->GetName() << std::endl;
+    entries = inTree->GetEntries();
+  }
+
+  // Each thread opens the file and reads one contiguous range of entries
+  headers.resize( entries );
+  nthreads = std::max<Long64_t>( 1, std::min<Long64_t>( nthreads, entries/10000 ) ); // Opening a file is not free
+  ROOT::EnableThreadSafety();
+  std::vector<char> ok( nthreads, 0 );
+  std::vector<std::thread> readers;
+  for(unsigned t = 0; t < nthreads; t++){
+    Long64_t begin = entries*t/nthreads;
+    Long64_t end = entries*(t + 1)/nthreads;
+    readers.emplace_back( [&, t, begin, end](){ ok[t] = read_header_range( runFile, begin, end, headers.data() + begin ); } );
+  }
+  for(size_t t = 0; t < readers.size(); t++) readers[t].join();
+  return std::find( ok.begin(), ok.end(), 0 ) == ok.end();
+}
+
+// Trigger gap or event jump found between an entry and the previous one
+struct Anomaly{
+  int entry;
+  bool triggerGap; // Frame difference bigger than the trigger period (missed trigger?)
+  bool eventJump; // Event number difference bigger than 1
+  bool desync; // In the middle of a crate readout: FEMs are desynchronized
+};
 
+// Result of the analysis of a range of entries
+struct ChunkResult{
+  double triggerGaps = 0;
+  double eventJumps = 0;
+  double totalTriggers = 0;
+  std::vector<Anomaly> anomalies;
+  TH1D* hFrames = nullptr;
+  TH1D* hDeltaFrame = nullptr;
+  TH1D* hEvents = nullptr;
+  TH1D* hDeltaEvent = nullptr;
+};
+
+// Analyze entries [begin, end). Each entry is compared with the previous one only,
+// so a chunk only needs the last header of the chunk before it
+static void analyze_chunk( const std::vector<HeaderInfo>& headers, int begin, int end, ChunkResult& result,
+			   double maxDeltaFrame, int NFEMs, int firstFEM ){
+  for( int i = begin; i < end; i++ ){
+    const HeaderInfo* hinfo = &headers[i];
+    const HeaderInfo* prev = &headers[i - 1];
+    int thisFrame = (int)hinfo->frame;
+    result.hFrames->Fill(thisFrame);
+    int deltaFrame = thisFrame - (int)prev->frame;
+    result.hDeltaFrame->Fill(deltaFrame);
+    if( deltaFrame != 0 ) result.totalTriggers++;
+
+    int thisEvent = (int)hinfo->event;
+    result.hEvents->Fill(thisEvent);
+    int deltaEvent = thisEvent - (int)prev->event;
+    result.hDeltaEvent->Fill(deltaEvent);
+
+    int thisSlot = (int)hinfo->slot;
+    int prevSlot = (i == 1) ? firstFEM : (int)prev->slot;
+
+    Anomaly anomaly = {i, deltaFrame > maxDeltaFrame, deltaEvent > 1, false};
+    if( !anomaly.triggerGap && !anomaly.eventJump ) continue;
+    // If the difference occurs in the middle of a crate-readout, FEMs are desynchronized
+    anomaly.desync = (thisSlot != firstFEM && prevSlot != firstFEM + NFEMs - 1);
+    if( anomaly.triggerGap ) result.triggerGaps++;
+    if( anomaly.eventJump ) result.eventJumps++;
+    result.anomalies.push_back( anomaly );
+  }
+}
+
+// Print the crate readouts before and after an anomaly
+static void show_anomaly( const std::vector<HeaderInfo>& headers, const char* title, int i, int NFEMs ){
+  std::cout << "\n\n" << title << std::endl;
+  std::cout << "\tPREVIOUS EVENT" << std::endl;
+  for( int j = i - NFEMs; j < i; j++ ) show_entry( headers, j );
+  std::cout << "\tTHIS EVENT" << std::endl;
+  for( int j = i; j < i + NFEMs; j++ ) show_entry( headers, j );
+}
+
+// Parameters of the analysis
+struct AnalyzerOptions{
   double triggerRate = 0.2; // in Hz
   double frameLength = 2560.; // in 2 MHz samples
   int NFEMs = 10; // number of FEMs
   int firstFEM = 4; // slot of the first FEM
+  unsigned threads = 0; // Threads reading and checking headers (0: one per core)
+  bool batch = false; // No prompts, no header dumps and no interactive windows
+  std::string report; // Anomaly report, JSON or CSV depending on the extension (empty: none)
+  double maxMissedFraction = 0.; // Fraction of missed triggers and event jumps still counted as a good run
+};
 
-  // Input ROOT file
-  TFile inFile( runFile, "READ" );
-  if( !inFile.IsOpen() ){
-    std::cerr << "Unable to open file: " << runFile << std::endl;
-    exit(1);
+// Set one parameter from its command line name, false if unknown or not a number
+static bool set_option( AnalyzerOptions& options, const std::string& name, const std::string& value ){
+  try{
+    if( name == "trigger-rate" ) options.triggerRate = std::stod( value );
+    else if( name == "frame-length" ) options.frameLength = std::stod( value );
+    else if( name == "fems" ) options.NFEMs = std::stoi( value );
+    else if( name == "first-fem" ) options.firstFEM = std::stoi( value );
+    else if( name == "threads" ) options.threads = std::stoi( value );
+    else if( name == "report" ) options.report = value;
+    else if( name == "max-missed" ) options.maxMissedFraction = std::stod( value );
+    else return false;
+  }
+  catch( const std::exception& ){
+    return false;
+  }
+  return true;
+}
+
+// Read "name = value" lines (same names as the command line options, '#' starts a comment)
+static bool read_config( const char* configFile, AnalyzerOptions& options ){
+  std::ifstream config( configFile );
+  if( !config.is_open() ){
+    std::cerr << "ERROR: Could not open file " << configFile << std::endl;
+    return false;
+  }
+  std::string line;
+  for(int n = 1; std::getline( config, line ); n++){
+    line = line.substr( 0, line.find('#') );
+    size_t equal = line.find('=');
+    std::string name = line.substr( 0, equal );
+    name.erase( 0, name.find_first_not_of(" \t") );
+    name.erase( name.find_last_not_of(" \t") + 1 );
+    if( name.empty() ) continue;
+    std::string value = (equal == std::string::npos) ? "" : line.substr( equal + 1 );
+    value.erase( 0, value.find_first_not_of(" \t") );
+    value.erase( value.find_last_not_of(" \t") + 1 );
+    if( equal == std::string::npos || !set_option( options, name, value ) ){
+      std::cerr << "ERROR: " << configFile << ":" << n << ": bad parameter " << line << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+// Totals of the analysis of one run
+struct AnalyzerResult{
+  int entries = 0;
+  double triggerGaps = 0;
+  double eventJumps = 0;
+  double totalTriggers = 0;
+  int desyncs = 0;
+};
+
+// Escape a string for a JSON value
+static std::string json_string( const std::string& text ){
+  std::string escaped = "\"";
+  for(size_t i = 0; i < text.size(); i++){
+    if( text[i] == '"' || text[i] == '\\' ) escaped += '\\';
+    escaped += text[i];
   }
-  else std::cout << "Opening file: " << runFile << std::endl;
+  return escaped + "\"";
+}
 
-  // Get the input tree
-  const char* inTreeName = "decoderTree";
-  TTree *inTree = (TTree*)inFile.Get(inTreeName);
-  if( !inTree ){
-    std::cerr << "Tree not found: " << inTreeName << std::endl;
-    exit(1);
+// One line per anomaly (CSV) or one JSON document with the parameters, the totals and the anomalies
+static bool write_report( const char* runFile, const AnalyzerOptions& options, const AnalyzerResult& result,
+			  const std::vector<HeaderInfo>& headers, const std::vector<Anomaly>& anomalies ){
+  std::ofstream report( options.report );
+  if( !report.is_open() ){
+    std::cerr << "ERROR: Could not write file " << options.report << std::endl;
+    return false;
+  }
+  bool csv = (options.report.substr( options.report.find_last_of(".") + 1 ) == "csv");
+  if( csv ) report << "entry,type,desync,slot,event,frame,prev_slot,prev_event,prev_frame,delta_event,delta_frame\n";
+  else{
+    report << "{\n  \"file\": " << json_string( runFile ) << ",\n"
+	   << "  \"parameters\": {\"trigger_rate\": " << options.triggerRate << ", \"frame_length\": " << options.frameLength
+	   << ", \"fems\": " << options.NFEMs << ", \"first_fem\": " << options.firstFEM << "},\n"
+	   << "  \"entries\": " << result.entries << ",\n  \"triggers\": " << result.totalTriggers
+	   << ",\n  \"missed_triggers\": " << result.triggerGaps << ",\n  \"event_jumps\": " << result.eventJumps
+	   << ",\n  \"desyncs\": " << result.desyncs << ",\n  \"anomalies\": [";
+  }
+  const char* separator = "\n";
+  for(size_t a = 0; a < anomalies.size(); a++){
+    const Anomaly& anomaly = anomalies[a];
+    const HeaderInfo& h = headers[anomaly.entry];
+    const HeaderInfo& prev = headers[anomaly.entry - 1];
+    for(int type = 0; type < 2; type++){
+      if( !(type == 0 ? anomaly.triggerGap : anomaly.eventJump) ) continue;
+      const char* name = (type == 0) ? "trigger_gap" : "event_jump";
+      if( csv ){
+	report << anomaly.entry << "," << name << "," << anomaly.desync << "," << (int)h.slot << "," << h.event << "," << h.frame << ","
+	       << (int)prev.slot << "," << prev.event << "," << prev.frame << ","
+	       << (long)h.event - (long)prev.event << "," << (long)h.frame - (long)prev.frame << "\n";
+      }
+      else{
+	report << separator << "    {\"entry\": " << anomaly.entry << ", \"type\": \"" << name << "\", \"desync\": " << (anomaly.desync ? "true" : "false")
+	       << ", \"slot\": " << (int)h.slot << ", \"event\": " << h.event << ", \"frame\": " << h.frame
+	       << ", \"prev_slot\": " << (int)prev.slot << ", \"prev_event\": " << prev.event << ", \"prev_frame\": " << prev.frame << "}";
+	separator = ",\n";
+      }
+    }
   }
-  else std::cout << "Tree found: " << inTreeName << std::endl;
+  if( !csv ) report << (anomalies.empty() ? "]\n}\n" : "\n  ]\n}\n");
+  report.close();
+  return !report.fail();
+}
+
+// Exit status of the analysis: 0 good run, 1 unreadable input, 2 too many missed triggers/event jumps, 3 FEM desync
+const int kAnalyzerError = 1;
+const int kAnalyzerMissed = 2;
+const int kAnalyzerDesync = 3;
 
-  inTree->SetBranchStatus("waveform", 0); // Speed up by not reading the waveform
-  HeaderInfo* hinfo = NULL;
-  inTree->SetBranchAddress("header", &hinfo);
+int analyzer( const char* runFile, const AnalyzerOptions& options = AnalyzerOptions() ){
 
-  int entries = inTree->GetEntries();
+  double triggerRate = options.triggerRate;
+  double frameLength = options.frameLength;
+  int NFEMs = options.NFEMs;
+  int firstFEM = options.firstFEM;
+  unsigned nthreads = options.threads ? options.threads : std::max( 1u, std::thread::hardware_concurrency() );
+
+  // Headers only: the waveforms are not read
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  std::vector<HeaderInfo> headers;
+  if( !read_headers( runFile, headers, nthreads ) ) return kAnalyzerError;
+
+  int entries = headers.size();
   if( entries < 2 ){
     std::cerr << "Analyzer needs more than one entry to compute time interval" << std::endl;
-    exit(1);
+    return kAnalyzerError;
   }
 
   TH1D *hFrames = new TH1D("hFrames", "Event frames;Frame;Entries/1000 frames", 16778, 0, 16778000);
@@ -52,85 +310,86 @@ int analyzer( const char* runFile ){
   TH1D *hDeltaEvent = new TH1D("hDeltaEvent", "Event no. difference;#DeltaEvent;Entries/events", 100, 0, 100);
   hDeltaEvent->SetDirectory(gROOT);
 
-  inTree->GetEntry(0);
-  hFrames->Fill((int)hinfo->frame);
-  int prevFrame = (int)hinfo->frame;
-  hEvents->Fill((int)hinfo->event);
-  int prevEvent = (int)hinfo->event;
+  hFrames->Fill((int)headers[0].frame);
+  hEvents->Fill((int)headers[0].event);
 
-  int prevSlot = firstFEM;
-  int thisSlot = firstFEM;
-  int aux = 0;
+  // Entries 1 to N in chunks, each on its own histograms, added up in order afterwards
+  double maxDeltaFrame = 1.05/(triggerRate * frameLength * 0.5e-6); // 1.05 --> add 5% tolerance
+  size_t nchunks = std::max<size_t>( 1, std::min<size_t>( 4*nthreads, entries/10000 ) );
+  std::vector<ChunkResult> chunks( nchunks );
+  for(size_t c = 0; c < nchunks; c++){
+    TH1D* hists[4] = {hFrames, hDeltaFrame, hEvents, hDeltaEvent};
+    TH1D** copies[4] = {&chunks[c].hFrames, &chunks[c].hDeltaFrame, &chunks[c].hEvents, &chunks[c].hDeltaEvent};
+    for(size_t h = 0; h < 4; h++){
+      *copies[h] = (TH1D*)hists[h]->Clone( Form("%s_chunk%zu", hists[h]->GetName(), c) );
+      (*copies[h])->SetDirectory(nullptr);
+      (*copies[h])->Reset();
+    }
+  }
+  std::atomic<size_t> next(0);
+  auto work = [&](){
+    for(size_t c = next++; c < nchunks; c = next++){
+      int begin = 1 + (int)((entries - 1)*c/nchunks);
+      int end = 1 + (int)((entries - 1)*(c + 1)/nchunks);
+      analyze_chunk( headers, begin, end, chunks[c], maxDeltaFrame, NFEMs, firstFEM );
+    }
+  };
+  std::vector<std::thread> workers;
+  for(unsigned t = 1; t < nthreads && t < nchunks; t++) workers.emplace_back( work );
+  work();
+  for(size_t t = 0; t < workers.size(); t++) workers[t].join();
 
   double triggerGaps = 0; // Unexpected gap between triggers (missing triggers?)
   double eventJumps = 0; // FEM event number header jumps by >=2
   double  totalTriggers = 0; // Total triggers
+  int desyncs = 0; // Anomalies in the middle of a crate readout
+  std::vector<Anomaly> anomalies;
+  int aux = 0;
+  for(size_t c = 0; c < nchunks; c++){
+    ChunkResult& chunk = chunks[c];
+    triggerGaps += chunk.triggerGaps;
+    eventJumps += chunk.eventJumps;
+    totalTriggers += chunk.totalTriggers;
+    hFrames->Add( chunk.hFrames );
+    hDeltaFrame->Add( chunk.hDeltaFrame );
+    hEvents->Add( chunk.hEvents );
+    hDeltaEvent->Add( chunk.hDeltaEvent );
+    delete chunk.hFrames;
+    delete chunk.hDeltaFrame;
+    delete chunk.hEvents;
+    delete chunk.hDeltaEvent;
+    anomalies.insert( anomalies.end(), chunk.anomalies.begin(), chunk.anomalies.end() );
+  }
 
-  // Loop over 1 to N entries
-  for( int i = 1; i < entries; i++ ){
-    inTree->GetEntry(i);
-    int thisFrame = (int)hinfo->frame;
-    hFrames->Fill(thisFrame);
-    int deltaFrame = thisFrame - prevFrame;
-    hDeltaFrame->Fill(deltaFrame);
-    if( prevFrame != thisFrame ) totalTriggers++;
-    prevFrame = thisFrame;
-
-    int thisEvent = (int)hinfo->event;
-    hEvents->Fill(thisEvent);
-    int deltaEvent = thisEvent - prevEvent;
-    hDeltaEvent->Fill(deltaEvent);
-    prevEvent = thisEvent;
-
-    thisSlot = (int)hinfo->slot;
-
-    // Look for missed triggers when the frame difference between FEMs is bigger than the tolerance
-    if( deltaFrame > 1.05/(triggerRate * frameLength * 0.5e-6) ){ // 1.05 --> add 5% tolerance
-      std::cout << "\n\nTRIGGER GAP" << std::endl;
-      std::cout << "\tPREVIOUS EVENT" << std::endl;
-      for( int j = i - NFEMs; j < i; j++ ) inTree->Show(j);
-      std::cout << "\tTHIS EVENT" << std::endl;
-      for( int j = i; j < i + NFEMs; j++ ) inTree->Show(j);
-      triggerGaps++;
-      // If the frame difference occurs in the middle of a crate-readout, FEMs are desynchronized
-      if( thisSlot != firstFEM && prevSlot != firstFEM + NFEMs - 1 ){
-	std::cout << "DESYNC. Enter anything to continue" << std::endl;
-	std::cin >> aux;
-      }
-    }
-
-    // Look for event jumps
-    if(deltaEvent > 1){
-      std::cout << "\n\nMISSING EVENT" << std::endl;
-      std::cout << "\tPREVIOUS EVENT" << std::endl;
-      for( int j = i - NFEMs; j < i; j++ ) inTree->Show(j);
-      std::cout << "\tTHIS EVENT" << std::endl;
-      for( int j = i; j < i + NFEMs; j++ ) inTree->Show(j);
-      eventJumps++;
-      // If the event difference occurs in the middle of a crate-readout, FEMs are desynchronized
-      if( thisSlot != firstFEM && prevSlot != firstFEM + NFEMs - 1 ){
+  // Anomalies in file order
+  for(size_t a = 0; a < anomalies.size(); a++){
+    const Anomaly& anomaly = anomalies[a];
+    if( anomaly.desync ) desyncs++;
+    if( options.batch ) continue; // Only in the report
+    for(int type = 0; type < 2; type++){
+      if( !(type == 0 ? anomaly.triggerGap : anomaly.eventJump) ) continue;
+      show_anomaly( headers, type == 0 ? "TRIGGER GAP" : "MISSING EVENT", anomaly.entry, NFEMs );
+      if( anomaly.desync ){
 	std::cout << "DESYNC. Enter anything to continue" << std::endl;
 	std::cin >> aux;
       }
     }
-
-    inTree->GetEntry(i);
-    prevSlot = (int)hinfo->slot;
-  } // end of loop over N entries
+  }
+  double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
 
   std::cout << "--- Input parameters ---" << std::endl;
   std::cout << "Trigger rate: " << triggerRate << " Hz" << std::endl;
   std::cout << "Frame length: " << frameLength << " samples" << std::endl;
-  std::cout << "Number of FEMs: " << NFEMs << std::endl;
+  std::cout << "Number of FEMs: " << NFEMs << " (first slot " << firstFEM << ")" << std::endl;
 
   std::cout << "--- Output parameters ---" << std::endl;
   std::cout << "Missed triggers: " << triggerGaps << std::endl;
   std::cout << "Event jumps: " << eventJumps << std::endl;
+  std::cout << "FEM desyncs: " << desyncs << std::endl;
   std::cout << "Total triggers " << totalTriggers << std::endl;
   std::cout << "Fraction of missed triggers: " << triggerGaps/totalTriggers << std::endl;
   std::cout << "Fraction of event jumps: " << eventJumps/totalTriggers << std::endl;
-
-  inTree->ResetBranchAddresses(); // "detach" from local variables
+  std::cout << "Analyzed " << entries << " entries in " << seconds << " s (" << nthreads << " threads)" << std::endl;
 
   std::string outFileName(runFile);
   outFileName = outFileName.substr(0, outFileName.find_last_of(".")) + "_ana.root";
@@ -158,19 +417,69 @@ int analyzer( const char* runFile ){
 
   rootFile.Close();
 
-  return 0;
+  int status = 0;
+  if( desyncs > 0 ) status = kAnalyzerDesync;
+  else if( triggerGaps + eventJumps > options.maxMissedFraction*totalTriggers ) status = kAnalyzerMissed;
+
+  if( !options.report.empty() ){
+    AnalyzerResult result;
+    result.entries = entries;
+    result.triggerGaps = triggerGaps;
+    result.eventJumps = eventJumps;
+    result.totalTriggers = totalTriggers;
+    result.desyncs = desyncs;
+    if( !write_report( runFile, options, result, headers, anomalies ) ) return kAnalyzerError;
+    std::cout << "Report written to " << options.report << std::endl;
+  }
+
+  return status;
 }
 
 // To run as a standalone application
 # ifndef __CINT__
+static void print_usage(){
+  std::cerr << "Usage ./analyzer.exe [options] DECODED_RUN.root" << std::endl;
+  std::cerr << "      ./analyzer.exe [options] NEVIS_TPC_BINARY_FILE.dat (headers read from the frame index, built if needed)" << std::endl;
+  std::cerr << "  --batch           No prompts, header dumps or windows: for automated processing" << std::endl;
+  std::cerr << "  --report FILE     Write the anomalies to FILE, as JSON (.json) or CSV (.csv)" << std::endl;
+  std::cerr << "  --config FILE     Read the options below from FILE, one \"name = value\" per line" << std::endl;
+  std::cerr << "  --trigger-rate R  Trigger rate in Hz (default 0.2)" << std::endl;
+  std::cerr << "  --frame-length N  Frame length in 2 MHz samples (default 2560)" << std::endl;
+  std::cerr << "  --fems N          Number of FEMs in the crate (default 10)" << std::endl;
+  std::cerr << "  --first-fem S     Slot of the first FEM (default 4)" << std::endl;
+  std::cerr << "  --threads N       Threads reading and checking headers (0: one per core, default)" << std::endl;
+  std::cerr << "  --max-missed F    Fraction of missed triggers and event jumps still accepted (default 0)" << std::endl;
+  std::cerr << "Exit status: 0 good run, 1 error, 2 more missed triggers/event jumps than accepted, 3 FEM desync" << std::endl;
+}
+
 int main( int argc, char** argv ){
-  if( argc != 2 ){
-    std::cerr << "Usage ./analyzer.exe DECODED_RUN.root" << std::endl;
-    exit(1);
+  AnalyzerOptions options;
+  std::string runFile;
+  for(int i = 1; i < argc; i++){
+    std::string arg(argv[i]);
+    if( arg == "--batch" ) options.batch = true;
+    else if( arg == "--config" && i + 1 < argc ){
+      if( !read_config( argv[++i], options ) ) exit(kAnalyzerError);
+    }
+    else if( arg.compare( 0, 2, "--" ) == 0 && i + 1 < argc && set_option( options, arg.substr(2), argv[i + 1] ) ) i++;
+    else if( arg[0] != '-' && runFile.empty() ) runFile = arg;
+    else{
+      print_usage();
+      exit(kAnalyzerError);
+    }
+  }
+  if( runFile.empty() || options.NFEMs < 1 || options.triggerRate <= 0 || options.frameLength <= 0 ){
+    print_usage();
+    exit(kAnalyzerError);
+  }
+  if( options.batch ){
+    gROOT->SetBatch( true );
+    return analyzer( runFile.c_str(), options );
   }
   // To create interactive windows to see the plots
-  TRint theApp( "tapp", &argc, argv );
-  int status = analyzer( theApp.Argv(1) ); // TRint modifies argc & argv!
+  int rintArgc = 1;
+  TRint theApp( "tapp", &rintArgc, argv );
+  int status = analyzer( runFile.c_str(), options );
   theApp.Run();
   return status;
 }
@@ -0,0 +1,282 @@
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+
+#include "FrameDecoder.hh"
+#include "MappedFile.hh"
+#include "Logger.hh"
+
+// One way of decoding a binary file, run in its own process so that its peak memory can be measured
+// In-process paths call the decoding functions directly and write nothing; the others run decoder.exe
+struct BenchmarkPath{
+  std::string name;
+  std::vector<std::string> decoderArgs; // Empty for in-process paths
+  unsigned threads;
+  std::string output; // File written by the path, whose size is reported (empty: none)
+};
+
+// Result of one run of a path
+struct BenchmarkResult{
+  bool ok = false;
+  double seconds = 0.;
+  size_t frames = 0;
+  long peakRSS = 0; // kB
+  long long outputBytes = -1; // Size of the output file (-1: none)
+};
+
+// In-process decoding. Prints "Frames: N" like the run summary of decoder.exe
+static int run_in_process( const char* inFileName, const BenchmarkPath& path ){
+  MappedFile binFile;
+  if( !binFile.open( inFileName ) ) return 1;
+  std::vector<FrameSpan> spans = scan_frames( binFile.words(), binFile.nwords() );
+  if( path.name == "scan" ){
+    std::cout << "Frames: " << spans.size() << std::endl;
+    return 0;
+  }
+  std::atomic<size_t> next(0);
+  auto work = [&](){
+    FrameData frame;
+    for(size_t i = next++; i < spans.size(); i = next++){
+      decode_frame( binFile.words(), spans[i], frame );
+      check_frame( frame.header );
+    }
+  };
+  std::vector<std::thread> workers;
+  for(unsigned t = 1; t < path.threads; t++) workers.emplace_back( work );
+  work();
+  for(size_t t = 0; t < workers.size(); t++) workers[t].join();
+  std::cout << "Frames: " << spans.size() << std::endl;
+  return 0;
+}
+
+// Run a path in a child process and collect its time, frame count and peak resident memory
+static BenchmarkResult run_path( const char* inFileName, const BenchmarkPath& path, const std::string& decoderExe ){
+  BenchmarkResult result;
+  int pipeFd[2];
+  if( pipe( pipeFd ) != 0 ){
+    std::cerr << "ERROR: pipe failed: " << strerror(errno) << std::endl;
+    return result;
+  }
+  auto start = std::chrono::steady_clock::now();
+  pid_t pid = fork();
+  if( pid < 0 ){
+    std::cerr << "ERROR: fork failed: " << strerror(errno) << std::endl;
+    close( pipeFd[0] );
+    close( pipeFd[1] );
+    return result;
+  }
+  if( pid == 0 ){ // Child: stdout goes to the pipe
+    close( pipeFd[0] );
+    dup2( pipeFd[1], STDOUT_FILENO );
+    close( pipeFd[1] );
+    if( path.decoderArgs.empty() ) _exit( run_in_process( inFileName, path ) );
+    std::vector<char*> args;
+    args.push_back( const_cast<char*>(decoderExe.c_str()) );
+    for(size_t i = 0; i < path.decoderArgs.size(); i++) args.push_back( const_cast<char*>(path.decoderArgs[i].c_str()) );
+    args.push_back( const_cast<char*>(inFileName) );
+    args.push_back( nullptr );
+    execv( decoderExe.c_str(), args.data() );
+    std::cerr << "ERROR: Could not run " << decoderExe << ": " << strerror(errno) << std::endl;
+    _exit(127);
+  }
+
+  // Parent: read the output until the child exits
+  close( pipeFd[1] );
+  std::string output;
+  char buffer[4096];
+  ssize_t n;
+  while( (n = read( pipeFd[0], buffer, sizeof(buffer) )) > 0 ) output.append( buffer, n );
+  close( pipeFd[0] );
+  int status = 0;
+  struct rusage usage;
+  if( wait4( pid, &status, 0, &usage ) != pid ) return result;
+  result.seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+  result.peakRSS = usage.ru_maxrss;
+
+  // decoder.exe returns 0 when decoder() failed
+  bool exited = WIFEXITED(status);
+  int code = exited ? WEXITSTATUS(status) : -1;
+  result.ok = exited && (path.decoderArgs.empty() ? code == 0 : code == 1);
+  size_t pos = output.find( "Frames: " );
+  if( pos != std::string::npos ) result.frames = std::stoul( output.substr( pos + 8 ) );
+  else result.ok = false;
+  if( !result.ok ) std::cerr << "WARNING: Path " << path.name << " failed (exit status " << code << ")" << std::endl;
+  struct stat st;
+  if( !path.output.empty() && stat( path.output.c_str(), &st ) == 0 ) result.outputBytes = st.st_size;
+  return result;
+}
+
+// Run each path "repeat" times and print the best throughput and the size of the output
+// Returns 0 if every path succeeded
+static int run_paths( const char* inFileName, double megabytes, const std::vector<BenchmarkPath>& paths, int repeat, const std::string& decoderExe ){
+  std::cout << std::left << std::setw(24) << "Path" << std::right << std::setw(8) << "Threads"
+	    << std::setw(12) << "MB/s" << std::setw(12) << "Frames/s" << std::setw(14) << "Peak RSS MB"
+	    << std::setw(12) << "Output MB" << std::setw(8) << "Ratio" << std::endl;
+  bool allOk = true;
+  for(size_t p = 0; p < paths.size(); p++){
+    BenchmarkResult best;
+    for(int r = 0; r < repeat; r++){
+      BenchmarkResult result = run_path( inFileName, paths[p], decoderExe );
+      if( !result.ok ){
+	best = result;
+	break;
+      }
+      if( !best.ok || result.seconds < best.seconds ) best = result;
+    }
+    allOk = allOk && best.ok;
+    std::cout << std::left << std::setw(24) << paths[p].name << std::right << std::setw(8) << paths[p].threads;
+    if( !best.ok ){
+      std::cout << std::setw(12) << "failed" << std::endl;
+      continue;
+    }
+    std::cout << std::fixed << std::setprecision(1)
+	      << std::setw(12) << megabytes/best.seconds
+	      << std::setw(12) << best.frames/best.seconds
+	      << std::setw(14) << best.peakRSS/1024.;
+    if( best.outputBytes >= 0 ){
+      std::cout << std::setw(12) << best.outputBytes/1.e6
+		<< std::setprecision(2) << std::setw(8) << (best.outputBytes > 0 ? megabytes*1.e6/best.outputBytes : 0.);
+    }
+    std::cout << std::endl;
+    std::cout.unsetf( std::ios::floatfield );
+  }
+  return allOk ? 0 : 1;
+}
+
+// Compare the decoding paths. Returns 0 if every path succeeded
+int benchmark( const char* inFileName, unsigned threads, int repeat, const std::string& decoderExe ){
+  MappedFile binFile;
+  if( !binFile.open( inFileName ) ) return 1;
+  double megabytes = binFile.size()/1.e6;
+  binFile.close();
+
+  std::string baseName( inFileName );
+  baseName = baseName.substr(0, baseName.find_last_of("."));
+  std::string nthreads = std::to_string( threads );
+  std::vector<BenchmarkPath> paths = {
+    {"scan", {}, 1, ""},
+    {"decode", {}, 1, ""},
+    {"decode-threads", {}, threads, ""},
+  };
+  if( access( decoderExe.c_str(), X_OK ) == 0 ){
+    paths.push_back( {"decoder-root", {"--quiet"}, 1, baseName + ".root"} );
+    paths.push_back( {"decoder-root-threads", {"--quiet", "--threads", nthreads}, threads, baseName + ".root"} );
+    paths.push_back( {"decoder-native-threads", {"--quiet", "--format", "native", "--threads", nthreads}, threads, baseName + ".ndf"} );
+  }
+  else std::cerr << "WARNING: " << decoderExe << " not found, only the in-process paths are run" << std::endl;
+
+  std::cout << "Benchmark of " << inFileName << " (" << megabytes << " MB, best of " << repeat << ")" << std::endl;
+  return run_paths( inFileName, megabytes, paths, repeat, decoderExe );
+}
+
+// Write the ROOT file with every combination of compression and basket size: write throughput against file size
+// Returns 0 if every combination succeeded
+int sweep( const char* inFileName, unsigned threads, int repeat, const std::string& decoderExe,
+	   const std::vector<std::string>& compressions, const std::vector<std::string>& basketSizes, unsigned imtThreads ){
+  MappedFile binFile;
+  if( !binFile.open( inFileName ) ) return 1;
+  double megabytes = binFile.size()/1.e6;
+  binFile.close();
+  if( access( decoderExe.c_str(), X_OK ) != 0 ){
+    std::cerr << "ERROR: " << decoderExe << " not found" << std::endl;
+    return 1;
+  }
+
+  std::string baseName( inFileName );
+  baseName = baseName.substr(0, baseName.find_last_of("."));
+  std::vector<BenchmarkPath> paths;
+  for(size_t c = 0; c < compressions.size(); c++){
+    for(size_t b = 0; b < basketSizes.size(); b++){
+      BenchmarkPath path = {compressions[c] + " " + basketSizes[b],
+			    {"--quiet", "--threads", std::to_string( threads ), "--compression", compressions[c], "--basket-size", basketSizes[b]},
+			    threads, baseName + ".root"};
+      if( imtThreads > 0 ){
+	path.decoderArgs.push_back( "--imt" );
+	path.decoderArgs.push_back( std::to_string( imtThreads ) );
+      }
+      paths.push_back( path );
+    }
+  }
+  std::cout << "Compression sweep of " << inFileName << " (" << megabytes << " MB, best of " << repeat
+	    << (imtThreads > 0 ? ", IMT on " + std::to_string( imtThreads ) + " threads" : "") << ")" << std::endl;
+  return run_paths( inFileName, megabytes, paths, repeat, decoderExe );
+}
+
+// Comma-separated list
+static std::vector<std::string> split_list( const std::string& list ){
+  std::vector<std::string> items;
+  std::stringstream stream( list );
+  std::string item;
+  while( std::getline( stream, item, ',' ) ){
+    if( !item.empty() ) items.push_back( item );
+  }
+  return items;
+}
+
+// To run as a standalone application
+# ifndef __CINT__
+static void print_usage(){
+  std::cerr << "Usage ./benchmark.exe [--threads N] [--repeat N] [--decoder PATH] NEVIS_TPC_BINARY_FILE.dat..." << std::endl;
+  std::cerr << "      ./benchmark.exe --sweep [--compressions L] [--basket-sizes L] [--imt N] [--threads N] [--repeat N] NEVIS_TPC_BINARY_FILE.dat..." << std::endl;
+  std::cerr << "  --threads N      Threads of the threaded paths (0: one per core, default)" << std::endl;
+  std::cerr << "  --repeat N       Runs per path, the fastest is reported (default 3)" << std::endl;
+  std::cerr << "  --decoder PATH   decoder.exe used for the full decoding paths (default ./decoder.exe)" << std::endl;
+  std::cerr << "  --sweep          Only run decoder.exe with every combination of the compressions and basket sizes below" << std::endl;
+  std::cerr << "  --compressions L Comma-separated compressions of the sweep (default none,zlib:1,lz4:1,lz4:4,zstd:1,zstd:5)" << std::endl;
+  std::cerr << "  --basket-sizes L Comma-separated basket sizes in bytes of the sweep (default 32000,256000,1024000)" << std::endl;
+  std::cerr << "  --imt N          Also compress baskets on N threads with ROOT implicit multithreading in the sweep" << std::endl;
+  std::cerr << "The decoder.exe paths overwrite the .root and .ndf files of the input" << std::endl;
+}
+
+int main( int argc, char** argv ){
+  unsigned threads = 0;
+  int repeat = 3;
+  std::string decoderExe = "./decoder.exe";
+  bool doSweep = false;
+  std::vector<std::string> compressions = {"none", "zlib:1", "lz4:1", "lz4:4", "zstd:1", "zstd:5"};
+  std::vector<std::string> basketSizes = {"32000", "256000", "1024000"};
+  unsigned imtThreads = 0;
+  std::vector<std::string> inFileNames;
+  for(int i = 1; i < argc; i++){
+    std::string arg(argv[i]);
+    bool hasValue = (i + 1 < argc);
+    if( arg == "--threads" && hasValue ) threads = std::stoul( argv[++i] );
+    else if( arg == "--repeat" && hasValue ) repeat = std::max( 1, std::stoi( argv[++i] ) );
+    else if( arg == "--decoder" && hasValue ) decoderExe = argv[++i];
+    else if( arg == "--sweep" ) doSweep = true;
+    else if( arg == "--compressions" && hasValue ) compressions = split_list( argv[++i] );
+    else if( arg == "--basket-sizes" && hasValue ) basketSizes = split_list( argv[++i] );
+    else if( arg == "--imt" && hasValue ) imtThreads = std::stoul( argv[++i] );
+    else if( arg[0] != '-' ) inFileNames.push_back( arg );
+    else{
+      print_usage();
+      exit(1);
+    }
+  }
+  if( inFileNames.empty() ){
+    print_usage();
+    exit(1);
+  }
+  if( threads == 0 ) threads = std::max( 1u, std::thread::hardware_concurrency() );
+  set_log_level( kError ); // Mismatch warnings of the in-process paths are not part of the measurement
+
+  int status = 0;
+  for(size_t f = 0; f < inFileNames.size(); f++){
+    if( doSweep ) status |= sweep( inFileNames[f].c_str(), threads, repeat, decoderExe, compressions, basketSizes, imtThreads );
+    else status |= benchmark( inFileNames[f].c_str(), threads, repeat, decoderExe );
+  }
+  return status;
+}
+# endif
@@ -2,173 +2,213 @@
 #include <fstream>
 #include <iomanip>
 #include <vector>
-#include <map>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <algorithm>
+#include <unordered_map>
 
+#include <TROOT.h>
 #include <TRint.h>
 #include <TFile.h>
 #include <TTree.h>
 
 #include "HeaderInfo.hh"
+#include "EventView.hh"
+#include "ChannelMap.hh"
 
-// Struct holding all values that define a channel
-struct channel_address{
-
-  int fLArWire; // LArSoft wire
-  int fOrigWire; // TPC wire within plane
-  std::string fPlane; // Plane withing TPC
-  std::string fAdapterConnector; // BNL adapter board connector
-  int fAdapterPin; // BNL adapter board pin
-  int fAnalogConnector; // BNL analog board connector
-  int fAnalogPin; // BNL analog board pin
-  int fASIC; // BNL ASIC number
-  int fASICch; // BNL ASIC channel
-  int fFEMBch; // BNL FEM channel
-  int fFEMB; // BNL FEMB number
-  int fWIB; // WIB number
-  int fADCDec; // Channel-map mode ADC value (decimal)
-  std::string fADCHex; // Channel-map mode ADC value (hex)
-  int fSlot; // Nevis FEM slot within crate
-  int fFEMch; // Channel within Nevis FEM
-
-  channel_address() 
-    : fLArWire(-1), fOrigWire(-1), fPlane("NotUsed"), fAdapterConnector("N/A"), fAdapterPin(-1), fAnalogConnector(-1), fAnalogPin(-1), 
-      fASIC(-1), fASICch(-1), fFEMBch(-1), fFEMB(-1), fWIB(-1), fADCDec(-1), fADCHex("NAN"),
-      fSlot(-1), fFEMch(-1) {}
-
-  channel_address( int newLarwire, int newOrigwire, std::string newPlane, 
-		   std::string newAdapterConnector, int newAdapterPin, int newAnalogConnector, int newAnalogPin,
-		   int newAsic, int newAsicch, int newFembch, int newFemb, int newWib, int newAdcdec, std::string newAdchex,
-		   int newSlot = -1, int newFemch = -1 )
-    : fLArWire(newLarwire), fOrigWire(newOrigwire), fPlane(newPlane), 
-      fAdapterConnector(newAdapterConnector), fAdapterPin(newAdapterPin), 
-      fAnalogConnector(newAnalogConnector), fAnalogPin(newAnalogPin),
-      fASIC(newAsic), fASICch(newAsicch), fFEMBch(newFembch), fFEMB(newFemb), fWIB(newWib), fADCDec(newAdcdec), fADCHex(newAdchex),
-      fSlot(newSlot), fFEMch(newFemch) {}
-};
+// Votes for the channel-map mode ADC value of each (slot, FEM channel), and counters of the entries read
+struct ChannelVotes{
+  std::vector< std::unordered_map<uint16_t, uint32_t> > votes; // By 64*slot + FEM channel: ADC value -> entries
+  size_t entries = 0;
+  size_t noisyWaveforms = 0; // Waveforms whose samples are not all equal (voted with their most frequent value)
+  size_t incompleteFrames = 0; // Frames with less than 64 channels
 
-int channel_mapper( const char* mapper_run, const char* bnl_map_filename ){
+  ChannelVotes() : votes( ChannelMap::kSlots*64 ) {};
 
-  std::map< int, channel_address > channelMap;
+  void add( const ChannelVotes& other ){
+    for(size_t c = 0; c < votes.size(); c++){
+      for(std::unordered_map<uint16_t, uint32_t>::const_iterator it = other.votes[c].begin(); it != other.votes[c].end(); ++it) votes[c][it->first] += it->second;
+    }
+    entries += other.entries;
+    noisyWaveforms += other.noisyWaveforms;
+    incompleteFrames += other.incompleteFrames;
+  };
+};
 
-  // Read text file with BNL pin mapping
-  std::ifstream BNLFile;
-  // Variables to read the text file
-  int larwire, origwire, adapterPin, analogConnector, analogPin, asic, asicch, fembch, femb, wib, adcdec;
-  std::string plane, adapterConnector, adchex;
-  BNLFile.open( bnl_map_filename );
-  // Expects LArIAT_Pin_Mapping.xlsx to be saved as plain text file with columns separated by spaces 
-  while( BNLFile >> larwire >> origwire >> plane >> adapterConnector >> adapterPin >> analogConnector >> analogPin >> 
-	 asic >> asicch >> fembch >> femb >> wib >> adcdec >> adchex ){
-    // Build same key as the one produced by the BNL electronics running in channel-map mode
-    // ASIC number goes from 1-8 in text file. We subtract 1 to make it 0-7 (used by the binary file)
-    channel_address thisChannelAddress( larwire, origwire, plane, adapterConnector, adapterPin, analogConnector, analogPin, 
-					asic -1, asicch, fembch, femb, wib, adcdec, adchex ); 
-    int BNLKey = ( (thisChannelAddress.fFEMB & 0xF) << 8 ) + ( (thisChannelAddress.fASIC & 0xF) << 4 ) + (thisChannelAddress.fASICch & 0xF);
-
-    // Test if the key already existed when filling the map
-    std::pair< std::map< int, channel_address >::iterator, bool > retVal;
-    retVal = channelMap.insert( std::pair< int, channel_address >(BNLKey, thisChannelAddress) );
-    if( retVal.second == false ){
-      std::cerr << "ERROR: the triplet FEMB " << (thisChannelAddress.fFEMB & 0xF)
-		<< " ASIC " << ((thisChannelAddress.fASIC & 0xF) + 1) // ASIC number goes from 1-8 in text file
-		<< " ASICch " << (thisChannelAddress.fASICch & 0xF) << " is not unique in " << bnl_map_filename << std::endl;
-      exit(1);
+// Most frequent value of a waveform. Sets "constant" if all the samples are equal
+static uint16_t waveform_mode( const uint16_t* adc, size_t n, bool& constant ){
+  constant = true;
+  for(size_t t = 1; t < n; t++){
+    if( adc[t] != adc[0] ){
+      constant = false;
+      break;
     }
   }
-  BNLFile.close();
-
-  /*
-  // Sanity check
-  for( std::map< int, channel_address >::iterator it = channelMap.begin(); it != channelMap.end(); ++it){
-    channel_address& temp = it->second;
-    if( it->first != (( (temp.fFEMB & 0xF) << 8 ) + ( (temp.fASIC & 0xF) << 4 ) + ( temp.fASICch & 0xF )) ){
-      std::cerr << "ERROR: Channel map key " << it->first << " and values are not consistent" <<std::endl;
-      exit(1);
+  if( constant ) return n > 0 ? adc[0] : 0;
+  std::unordered_map<uint16_t, uint32_t> counts;
+  uint16_t mode = adc[0];
+  uint32_t best = 0;
+  for(size_t t = 0; t < n; t++){
+    uint32_t count = ++counts[adc[t]];
+    if( count > best ){
+      best = count;
+      mode = adc[t];
     }
   }
-  */
-  // Done with the BNL pin mapping
+  return mode;
+}
 
-  // ROOT file with the mapper run
+// Vote with the entries [begin, end) of decoderTree, read with a file handle of the calling thread
+static bool vote_range( const char* mapper_run, Long64_t begin, Long64_t end, ChannelVotes& votes ){
   TFile inFile( mapper_run, "READ" );
-  if( !inFile.IsOpen() ){
-    std::cerr << "Unable to open file: " << mapper_run << std::endl;
-    exit(1);
+  TTree *inTree = inFile.IsOpen() ? EventView::find_tree( &inFile ) : nullptr;
+  if( !inTree ) return false;
+  EventView view; // Reads flat and legacy (vector of vectors) waveforms
+  if( !view.attach( inTree, EventView::kSequential, begin, end ) ) return false;
+  for(Long64_t entry = begin; entry < end; entry++){
+    view.set_entry(entry);
+    votes.entries++;
+    if( view.nchannels() != 64 ) votes.incompleteFrames++;
+    if( view.header().slot >= ChannelMap::kSlots ) continue; // Its samples are not read
+    for(size_t ich = 0; ich < view.nchannels() && ich < 64; ich++){
+      ChannelView adc = view.channel(ich);
+      if( adc.empty() ) continue;
+      bool constant = true;
+      uint16_t value = waveform_mode( adc.data(), adc.size(), constant );
+      if( !constant ) votes.noisyWaveforms++;
+      votes.votes[64*view.header().slot + ich][value]++;
+    }
   }
-  else std::cout << "Opening file: " << mapper_run << std::endl;
+  view.detach();
+  return true;
+}
+
+int channel_mapper( const char* mapper_run, const char* bnl_map_filename, unsigned nthreads = 0, double minAgreement = 0.5 ){
 
-  // Get the input tree
-  const char* inTreeName = "decoderTree";
-  TTree *inTree = (TTree*)inFile.Get(inTreeName);
-  if( !inTree ){
-    std::cerr << "Tree not found: " << inTreeName << std::endl;
+  // Read text file with BNL pin mapping
+  // Expects LArIAT_Pin_Mapping.xlsx to be saved as plain text file with columns separated by spaces
+  ChannelMap channelMap;
+  std::string error;
+  if( !channelMap.read_text( bnl_map_filename, error ) ){
+    std::cerr << "ERROR: " << error << std::endl;
     exit(1);
   }
-  else std::cout << "Tree found: " << inTreeName << std::endl;
-
-  std::vector< std::vector<uint16_t> >* waveform = NULL;
-  inTree->SetBranchAddress("waveform", &waveform);
-  HeaderInfo* hinfo = NULL;
-  inTree->SetBranchAddress("header", &hinfo);
-
-  uint16_t useEvent = 1; // Event number to be used for building the map
+  // Done with the BNL pin mapping
 
-  int bASICch = -1; // BNL's ASIC channel
-  int bASICno = -1; // BNL's ASIC number
-  int bFEMBno = -1; // BNL's FEMB number
+  // ROOT file with the mapper run
+  Long64_t entries = 0;
+  {
+    TFile inFile( mapper_run, "READ" );
+    if( !inFile.IsOpen() ){
+      std::cerr << "Unable to open file: " << mapper_run << std::endl;
+      exit(1);
+    }
+    else std::cout << "Opening file: " << mapper_run << std::endl;
 
-  // Loop over FEMs in one event
-  int entry = 0;
-  while( inTree->GetEntry(entry) && hinfo->event == useEvent ){
-    std::cout << "Processing entry " << entry << ": event " << hinfo->event << ", FEM " << (int)(hinfo->slot) << std::endl;
+    // Get the input tree (decoderTree, or roiTree of a zero-suppressed file)
+    TTree *inTree = EventView::find_tree( &inFile );
+    if( !inTree ){
+      std::cerr << "Tree not found: decoderTree or roiTree" << std::endl;
+      exit(1);
+    }
+    else std::cout << "Tree found: " << inTree->GetName() << std::endl;
+    EventView view;
+    if( !view.attach( inTree, EventView::kRandom ) ) exit(1);
+    entries = view.entries();
+    view.detach();
+  }
 
-    if( (*waveform).size() != 64 ){
-      std::cerr << "ERROR: less than 64 channels found in FEM" << std::endl; 
+  // Every entry votes for the ADC value of each of its channels (the BNL key it reads), in one pass on several threads
+  if( nthreads == 0 ) nthreads = std::max( 1u, std::thread::hardware_concurrency() );
+  nthreads = std::max<Long64_t>( 1, std::min<Long64_t>( nthreads, entries ) );
+  ROOT::EnableThreadSafety();
+  std::vector<ChannelVotes> threadVotes( nthreads );
+  std::vector<char> ok( nthreads, 0 );
+  std::vector<std::thread> readers;
+  for(unsigned t = 0; t < nthreads; t++){
+    Long64_t begin = entries*t/nthreads;
+    Long64_t end = entries*(t + 1)/nthreads;
+    readers.emplace_back( [&, t, begin, end](){ ok[t] = vote_range( mapper_run, begin, end, threadVotes[t] ); } );
+  }
+  for(size_t t = 0; t < readers.size(); t++) readers[t].join();
+  ChannelVotes votes;
+  for(unsigned t = 0; t < nthreads; t++){
+    if( !ok[t] ){
+      std::cerr << "ERROR: Could not read " << mapper_run << std::endl;
       exit(1);
     }
-    
-    // Loop over channels in one FEM
-    for(size_t ich = 0; ich < (*waveform).size(); ich++){
-      std::cout << "\tReading channel " << ich << std::endl;
-      int lastADC = 0;
-      // Loop over ADCs in one channel
-      // Check all ADCs have the same value
-      for(size_t t = 0; t < (*waveform)[ich].size(); t++){
-	if( t > 0 && lastADC != (int)(*waveform)[ich][t] ){
-	  std::cerr << "\tERROR: ADC do not remain constant in channel" << std::endl; 
-	  exit(1);
-	}
-	lastADC = (int)(*waveform)[ich][t];
-      }
-      bASICch = lastADC & 0xF;
-      bASICno = (lastADC >> 4) & 0xF;
-      // The maximum number of ASICs per FEMB is 8
-      if( bASICno > 7 ){
-	std::cerr << "\tERROR: ADC data is wrong (ASIC number is out of bounds)" << std::endl; 
-	exit(1);
-      }
-      bFEMBno = (lastADC >> 8) & 0xF;
-      // The maximum number of FEMBs in LArIAT VST is 5
-      if( bFEMBno > 5 ){
-	std::cerr << "\tERROR: ADC data is wrong (FEMB number is out of bounds)" << std::endl; 
-	exit(1);	
+    votes.add( threadVotes[t] );
+  }
+
+  // Winning value of each channel. Values that are not a valid BNL address, or not voted by enough entries, are not used
+  std::ostringstream problems;
+  size_t channels = 0, unanimous = 0, split = 0, invalid = 0, duplicates = 0;
+  uint64_t totalVotes = 0, winningVotes = 0;
+  std::vector<int32_t> keyChannel( ChannelMap::kKeys, -1 ); // FEM channel (64*slot + channel) that reads each key
+  std::vector<uint32_t> keyVotes( ChannelMap::kKeys, 0 );
+  for(size_t c = 0; c < votes.votes.size(); c++){
+    const std::unordered_map<uint16_t, uint32_t>& channelVotes = votes.votes[c];
+    if( channelVotes.empty() ) continue;
+    channels++;
+    uint16_t lastADC = 0;
+    uint32_t best = 0, total = 0;
+    for(std::unordered_map<uint16_t, uint32_t>::const_iterator it = channelVotes.begin(); it != channelVotes.end(); ++it){
+      total += it->second;
+      if( it->second > best || (it->second == best && it->first < lastADC) ){
+	best = it->second;
+	lastADC = it->first;
       }
-      // std:: cout << "FEM " << std::setw(2) << (int)(hinfo->slot) << " Channel " << std::setw(2) << ich 
-      // 		 << " ASIC channel " << std::setw(2) << bASICch << " ASIC number " << bASICno << " FEMB number " << bFEMBno << std::endl; 
-      
-      // Add the Nevis FEM slot and channel to the channel map
-      // Do not check for existence since some FEM channels are not connected to a wire and do not appear in the text file
-      (channelMap[lastADC]).fSlot = (int)(hinfo->slot);
-      (channelMap[lastADC]).fFEMch = (int)ich;
-      // Write the ASIC channel, number and FEMB number to make sure all channels have them
-      (channelMap[lastADC]).fASICch = bASICch;
-      (channelMap[lastADC]).fASIC = bASICno;
-      (channelMap[lastADC]).fFEMB = bFEMBno;
-
-    } // end of loop over channels in one FEM
-    entry++;
-  } // end of loop over FEMs in one event
+    }
+    totalVotes += total;
+    winningVotes += best;
+    if( best == total ) unanimous++;
+    else{
+      split++;
+      problems << "  Slot " << std::setw(2) << c/64 << " channel " << std::setw(2) << c%64 << ": " << std::setprecision(3) << 100.*best/total << "% of "
+	       << total << " entries for 0x" << std::hex << lastADC << std::dec << "\n";
+    }
+    int bASICno = (lastADC >> 4) & 0xF; // BNL's ASIC number
+    int bFEMBno = (lastADC >> 8) & 0xF; // BNL's FEMB number
+    // The maximum number of ASICs per FEMB is 8, and the maximum number of FEMBs in LArIAT VST is 5
+    if( bASICno > 7 || bFEMBno > 5 || lastADC > 0xFFF || best < minAgreement*total ){
+      invalid++;
+      problems << "  Slot " << std::setw(2) << c/64 << " channel " << std::setw(2) << c%64 << ": 0x" << std::hex << lastADC << std::dec
+	       << (best < minAgreement*total ? " not agreed on, channel not mapped\n" : " is not a valid BNL address (ASIC or FEMB number out of bounds), channel not mapped\n");
+      continue;
+    }
+    // Two FEM channels reading the same key: the one with more votes keeps it
+    if( keyChannel[lastADC] >= 0 ){
+      duplicates++;
+      int other = keyChannel[lastADC];
+      problems << "  Key 0x" << std::hex << lastADC << std::dec << " read by slot " << other/64 << " channel " << other%64 << " and slot " << c/64
+	       << " channel " << c%64 << "\n";
+      if( best <= keyVotes[lastADC] ) continue;
+    }
+    keyChannel[lastADC] = c;
+    keyVotes[lastADC] = best;
+  }
+  // Add the Nevis FEM slot and channel to the channel map, with the ASIC channel, number and FEMB number
+  // Do not check for existence since some FEM channels are not connected to a wire and do not appear in the text file
+  for(uint16_t key = 0; key < ChannelMap::kKeys; key++){
+    if( keyChannel[key] >= 0 ) channelMap.set_fem_channel( key, keyChannel[key]/64, keyChannel[key]%64 );
+  }
+  // Channels of the pin map that no FEM channel reads
+  size_t missing = 0;
+  for(size_t r = 0; r < channelMap.size(); r++){
+    const ChannelMapRecord& record = channelMap.record(r);
+    if( record.slot >= 0 || record.larWire < 0 ) continue;
+    missing++;
+    problems << "  Wire " << record.larWire << " (" << channelMap.plane( record ) << ", key 0x" << std::hex << record.key << std::dec << ") is not read by any FEM channel\n";
+  }
+
+  std::cout << "Channel map built from " << votes.entries << " entries:\n"
+	    << "  FEM channels: " << channels << " (" << unanimous << " unanimous, " << split << " split, " << invalid << " not mapped)\n"
+	    << "  Agreement: " << (totalVotes > 0 ? 100.*winningVotes/totalVotes : 0.) << "% of the votes for the winning values\n"
+	    << "  Keys read by more than one FEM channel: " << duplicates << "\n"
+	    << "  Wires not read by any FEM channel: " << missing << "\n"
+	    << "  Waveforms not constant: " << votes.noisyWaveforms << ", frames with less than 64 channels: " << votes.incompleteFrames << "\n"
+	    << problems.str() << std::flush;
   // Done with the ROOT file with the mapper run
 
   // Print the channel map
@@ -184,15 +224,19 @@ int channel_mapper( const char* mapper_run, const char* bnl_map_filename ){
   std::string channelMap_filename_txt = channelMap_filename + ".txt";
   std::cout << "Writing channel map as text file to " << channelMap_filename_txt << std::endl;
   channelMap_file.open( channelMap_filename_txt, std::ios::out );
-  for( std::map< int, channel_address >::iterator it = channelMap.begin(); it != channelMap.end(); ++it){
-    channel_address& val = it->second;
-    channelMap_file << std::right << std::setw(3) << val.fLArWire << " " << std::setw(3) << val.fOrigWire << " " << std::setw(10) << val.fPlane << " " 
-		     << std::setw(3) << val.fAdapterConnector << " " << std::setw(2) << val.fAdapterPin << " " 
-		     << std::setw(2) << val.fAnalogConnector << " " << std::setw(2) << val.fAnalogPin << " "
-		     << std::setw(2) << val.fASIC << " " << std::setw(2) << val.fASICch << " "
-		     << std::setw(3) << val.fFEMBch << " " << std::setw(2) << val.fFEMB << " " << std::setw(2) << val.fWIB << " "
-		     << std::setw(4) << val.fADCDec << " " << std::setw(3) << val.fADCHex << " "
-		     << std::setw(2) << val.fSlot << " " << std::setw(2) << val.fFEMch << std::endl;
+  for(uint16_t key = 0; key < ChannelMap::kKeys; key++){
+    const ChannelMapRecord* val = channelMap.find_key( key );
+    if( !val ) continue;
+    std::ostringstream adchex;
+    if( val->adc >= 0 ) adchex << std::uppercase << std::hex << val->adc;
+    else adchex << "NAN";
+    channelMap_file << std::right << std::setw(3) << val->larWire << " " << std::setw(3) << val->origWire << " " << std::setw(10) << channelMap.plane( *val ) << " "
+		     << std::setw(3) << channelMap.adapter_connector( *val ) << " " << std::setw(2) << val->adapterPin << " "
+		     << std::setw(2) << val->analogConnector << " " << std::setw(2) << val->analogPin << " "
+		     << std::setw(2) << (int)val->asic << " " << std::setw(2) << (int)val->asicch << " "
+		     << std::setw(3) << val->fembch << " " << std::setw(2) << (int)val->femb << " " << std::setw(2) << (int)val->wib << " "
+		     << std::setw(4) << val->adc << " " << std::setw(3) << adchex.str() << " "
+		     << std::setw(2) << (int)val->slot << " " << std::setw(2) << (int)val->femch << std::endl;
   }
   channelMap_file.close();
 
@@ -205,19 +249,41 @@ int channel_mapper( const char* mapper_run, const char* bnl_map_filename ){
   mapTree->Write();
   outFile.Close();
 
+  // Binary map, loaded by the decoder (see ChannelMap.hh)
+  std::string channelMap_filename_bin = channelMap_filename + ".chmap";
+  std::cout << "Writing channel map as binary file to " << channelMap_filename_bin << std::endl;
+  if( !channelMap.save( channelMap_filename_bin ) ){
+    std::cerr << "ERROR: Could not create file " << channelMap_filename_bin << std::endl;
+    exit(1);
+  }
+
   return 0;
 }
 
 // To run as a standalone application
 # ifndef __CINT__
 int main( int argc, char** argv ){
-  if( argc != 3 ){
-    std::cerr << "Usage ./channel_mapper.exe DECODED_MAPPER_RUN.root BNL_PIN_MAP.txt" << std::endl;
+  unsigned nthreads = 0;
+  double minAgreement = 0.5;
+  std::vector<std::string> files;
+  bool badOption = false;
+  for(int i = 1; i < argc; i++){
+    std::string arg(argv[i]);
+    if( arg == "--threads" && i + 1 < argc ) nthreads = std::stoi( argv[++i] );
+    else if( arg == "--min-agreement" && i + 1 < argc ) minAgreement = std::stod( argv[++i] );
+    else if( arg[0] != '-' ) files.push_back( arg );
+    else badOption = true;
+  }
+  if( badOption || files.size() != 2 ){
+    std::cerr << "Usage ./channel_mapper.exe [--threads N] [--min-agreement F] DECODED_MAPPER_RUN.root BNL_PIN_MAP.txt" << std::endl;
+    std::cerr << "  --threads N        Read the mapper run on N threads (0: one per core, default)" << std::endl;
+    std::cerr << "  --min-agreement F  Fraction of the entries that must agree on the value of a channel to map it (default 0.5)" << std::endl;
     exit(1);
   }
   // To create interactive windows to see the plots
-  TRint theApp( "tapp", &argc, argv );
-  int status = channel_mapper( theApp.Argv(1), theApp.Argv(2) ); // TRint modifies argc & argv!
+  int rintArgc = 1;
+  TRint theApp( "tapp", &rintArgc, argv );
+  int status = channel_mapper( files[0].c_str(), files[1].c_str(), nthreads, minAgreement );
   theApp.Run();
   return status;
 }
@@ -0,0 +1,169 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <fstream>
+
+#include <TROOT.h>
+#include <TFile.h>
+#include <TTree.h>
+
+#include "HeaderInfo.hh"
+#include "EventView.hh"
+#include "NativeFormat.hh"
+#include "Encoder.hh"
+
+// Write the entries of decoderTree to a native file
+static int root_to_native( const std::string& inFileName, const std::string& outFileName ){
+  TFile inFile( inFileName.c_str(), "READ" );
+  if( !inFile.IsOpen() ){
+    std::cerr << "Unable to open file: " << inFileName << std::endl;
+    return 1;
+  }
+  TTree *inTree = EventView::find_tree( &inFile );
+  if( !inTree ){
+    std::cerr << "Tree not found: decoderTree or roiTree" << std::endl;
+    return 1;
+  }
+  EventView view; // Reads flat and legacy (vector of vectors) waveforms
+  if( !view.attach( inTree ) ) return 1;
+
+  NativeWriter outFile;
+  if( !outFile.open( outFileName ) ){
+    std::cerr << "Unable to create file: " << outFileName << std::endl;
+    return 1;
+  }
+  std::vector<uint16_t> samples;
+  std::vector<uint32_t> offsets(65);
+  Long64_t entries = view.entries();
+  for(Long64_t entry = 0; entry < entries; entry++){
+    view.set_entry(entry);
+    samples.clear();
+    offsets[0] = 0;
+    for(size_t ch = 0; ch < 64; ch++){
+      if( ch < view.nchannels() ) samples.insert( samples.end(), view.channel(ch).begin(), view.channel(ch).end() );
+      offsets[ch + 1] = samples.size();
+    }
+    if( !outFile.write( view.header(), samples, offsets ) ) break;
+  }
+  view.detach();
+  if( !outFile.close() ){
+    std::cerr << "Unable to write file: " << outFileName << std::endl;
+    return 1;
+  }
+  std::cout << entries << " entries written to " << outFileName << std::endl;
+  return 0;
+}
+
+// Write the frames of a native file to decoderTree
+static int native_to_root( const std::string& inFileName, const std::string& outFileName ){
+  NativeReader inFile;
+  if( !inFile.open( inFileName ) ){
+    std::cerr << "Unable to open file: " << inFileName << std::endl;
+    return 1;
+  }
+  TFile outFile( outFileName.c_str(), "RECREATE" );
+  HeaderInfo header;
+  std::vector<uint16_t> samples;
+  std::vector<uint32_t> offsets;
+  TTree* outTree = new TTree("decoderTree", "Decoder output tree");
+  outTree->Branch("header", &header );
+  outTree->Branch("samples", &samples );
+  outTree->Branch("offsets", &offsets );
+  for(size_t i = 0; i < inFile.nframes(); i++){
+    header = inFile.header(i);
+    const NativeFrameRecord& record = inFile.record(i);
+    samples.assign( inFile.samples(i), inFile.samples(i) + record.offsets[64] );
+    offsets.assign( record.offsets, record.offsets + 65 );
+    outTree->Fill();
+  }
+  outTree->Write();
+  outFile.Close();
+  std::cout << inFile.nframes() << " entries written to " << outFileName << std::endl;
+  return 0;
+}
+
+// Re-encode the frames of a decoded file (ROOT or native) as a Nevis binary file with Huffman-packed samples
+// Word counts and checksums are recomputed, so frames that had mismatches are written consistent
+static int to_binary( const std::string& inFileName, const std::string& outFileName, bool native ){
+  std::ofstream outFile( outFileName, std::ios::binary );
+  if( !outFile.is_open() ){
+    std::cerr << "Unable to create file: " << outFileName << std::endl;
+    return 1;
+  }
+  std::vector<uint16_t> words16b;
+  std::vector<uint32_t> words32b;
+  auto write_frame = [&]( HeaderInfo header, const uint16_t* samples, const uint32_t* offsets ){
+    words16b.clear();
+    words32b.clear();
+    encode_frame( words16b, header, samples, offsets );
+    pack_words( words16b, words32b );
+    outFile.write( reinterpret_cast<const char*>(words32b.data()), words32b.size()*sizeof(uint32_t) );
+  };
+
+  size_t nframes = 0;
+  if( native ){
+    NativeReader inFile;
+    if( !inFile.open( inFileName ) ){
+      std::cerr << "Unable to open file: " << inFileName << std::endl;
+      return 1;
+    }
+    for(nframes = 0; nframes < inFile.nframes(); nframes++){
+      write_frame( inFile.header(nframes), inFile.samples(nframes), inFile.record(nframes).offsets );
+    }
+  }
+  else{
+    TFile inFile( inFileName.c_str(), "READ" );
+    TTree *inTree = inFile.IsOpen() ? EventView::find_tree( &inFile ) : nullptr;
+    if( !inTree ){
+      std::cerr << "Unable to read decoderTree or roiTree from file: " << inFileName << std::endl;
+      return 1;
+    }
+    EventView view; // Reads flat and legacy (vector of vectors) waveforms
+    if( !view.attach( inTree ) ) return 1;
+    std::vector<uint16_t> samples;
+    std::vector<uint32_t> offsets(65);
+    for(Long64_t entry = 0; entry < view.entries(); entry++){
+      view.set_entry(entry);
+      samples.clear();
+      for(size_t ch = 0; ch < 64; ch++){
+	if( ch < view.nchannels() ) samples.insert( samples.end(), view.channel(ch).begin(), view.channel(ch).end() );
+	offsets[ch + 1] = samples.size();
+      }
+      write_frame( view.header(), samples.data(), offsets.data() );
+      nframes++;
+    }
+    view.detach();
+  }
+  double megabytes = outFile.tellp()/1.e6;
+  outFile.close();
+  std::cout << nframes << " frames written to " << outFileName << " (" << megabytes << " MB)" << std::endl;
+  return 0;
+}
+
+// Convert a decoded file between the ROOT and native formats, or back to a binary file
+int converter( const char* inFile, bool toBinary ){
+  std::string inFileName(inFile);
+  std::string extension = inFileName.substr( inFileName.find_last_of(".") + 1 );
+  std::string baseName = inFileName.substr(0, inFileName.find_last_of("."));
+  if( toBinary && (extension == "root" || extension == "ndf") ){ // Not .dat, so the original binary file is kept
+    return to_binary( inFileName, baseName + "_reencoded.dat", extension == "ndf" );
+  }
+  if( extension == "root" ) return root_to_native( inFileName, baseName + ".ndf" );
+  if( extension == "ndf" ) return native_to_root( inFileName, baseName + ".root" );
+  std::cerr << "Unknown file type: " << inFileName << " (expected .root or .ndf)" << std::endl;
+  return 1;
+}
+
+// To run as a standalone application
+# ifndef __CINT__
+int main( int argc, char** argv ){
+  bool toBinary = (argc == 3 && std::string(argv[1]) == "--binary");
+  if( argc != 2 && !toBinary ){
+    std::cerr << "Usage ./converter.exe DECODED_RUN.root (writes DECODED_RUN.ndf)" << std::endl;
+    std::cerr << "      ./converter.exe DECODED_RUN.ndf (writes DECODED_RUN.root)" << std::endl;
+    std::cerr << "      ./converter.exe --binary DECODED_RUN.root|ndf (writes DECODED_RUN_reencoded.dat)" << std::endl;
+    exit(1);
+  }
+  return converter( argv[argc - 1], toBinary );
+}
+# endif
@@ -1,7 +1,25 @@
 #include <iostream>
 #include <iomanip>
-#include <fstream>
 #include <vector>
+#include <chrono>
+#include <string>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <csignal>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <sstream>
+#include <fstream>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <glob.h>
+#include <sys/stat.h>
 
 #include <TROOT.h>
 #include <TFile.h>
@@ -9,237 +27,932 @@
 
 #include "decoder.hh"
 #include "HeaderInfo.hh"
+#include "MappedFile.hh"
+#include "FrameDecoder.hh"
+#include "Huffman.hh"
+#include "Logger.hh"
+#include "NativeFormat.hh"
+#include "Encoder.hh"
+#include "Verifier.hh"
+#include "FrameIndex.hh"
+#include "EventBuilder.hh"
+#include "ChannelMap.hh"
+#include "WireOrder.hh"
+#include "ChannelStats.hh"
+#include "Roi.hh"
+
+// Everything done with a decoded frame, in file order: checks, run summary and outputs
+class EntryWriter{
+public:
+  EntryWriter( TTree* tree, NativeWriter* native, int basketSize = 32000 ); // Either output can be null
+  // Fill "tree" with the regions of interest found by "roi" instead of the whole waveforms (whole waveforms if null)
+  EntryWriter( TTree* tree, NativeWriter* native, int basketSize, const RoiFinder* roi );
+  // Also build crate events from the frames and fill them into "eventTree" (one entry per trigger)
+  void build_events( EventBuilder* builder, TTree* eventTree, int basketSize = 32000 );
+  void write( FrameData& frame ); // Takes the contents of a packed frame
+  // Also fill the crate events, in LArSoft wire order, into "wireTree" (one wires x samples branch per plane)
+  void write_wires( const WireOrder* wireOrder, TTree* wireTree, int basketSize = 32000 );
+  void finish(); // Write the events still open in the event builder
+  void set_channel_map( const ChannelMap* channelMap ){ fChannelMap = channelMap; };
+  void set_channel_stats( ChannelStats* stats ){ fStats = stats; }; // Noise statistics of every decoded channel
+  size_t entries() const { return fEntries; };
+  size_t wire_channels() const { return fWireChannels; }; // Decoded channels connected to a wire in the channel map
+  size_t rois() const { return fRois; };
+  size_t roi_samples() const { return fRoiSamples; }; // Samples kept in the regions of interest
+  size_t all_samples() const { return fAllSamples; }; // Samples decoded
+
+  RunSummary summary;
+
+private:
+  void write_events();
+
+  TTree* fTree;
+  NativeWriter* fNative;
+  FrameData fEntry; // Bound to the branches
+  size_t fEntries = 0;
+  EventBuilder* fBuilder = nullptr;
+  TTree* fEventTree = nullptr;
+  CrateEvent fEvent; // Bound to the branches of eventTree
+  const WireOrder* fWireOrder = nullptr;
+  TTree* fWireTree = nullptr;
+  std::vector< std::vector<uint16_t> > fPlanes; // Bound to the branches of wireTree
+  uint32_t fNSamples = 0;
+  const ChannelMap* fChannelMap = nullptr;
+  size_t fWireChannels = 0;
+  ChannelStats* fStats = nullptr;
+  const RoiFinder* fRoiFinder = nullptr;
+  RoiFrame fRoi; // Bound to the branches in ROI mode
+  std::vector<uint16_t> fRoiScratch;
+  size_t fRois = 0;
+  size_t fRoiSamples = 0;
+  size_t fAllSamples = 0;
+};
+
+EntryWriter::EntryWriter( TTree* tree, NativeWriter* native, int basketSize, const RoiFinder* roi ) : fTree(tree), fNative(native), fRoiFinder(roi){
+  if( !fTree ) return;
+  fTree->Branch("header", &fEntry.header, basketSize );
+  if( !fRoiFinder ){
+    // The 64 channels share one sample buffer: channel ch is samples[offsets[ch], offsets[ch+1])
+    fTree->Branch("samples", &fEntry.samples, basketSize );
+    fTree->Branch("offsets", &fEntry.offsets, basketSize );
+    return;
+  }
+  // ROI r is channel roiChannels[r] from tick roiStarts[r], samples[roiOffsets[r], roiOffsets[r+1])
+  // With the pedestals and the channel sizes, EventView rebuilds the zero-suppressed waveforms
+  fTree->Branch("pedestals", &fRoi.pedestals, basketSize );
+  fTree->Branch("sizes", &fRoi.sizes, basketSize );
+  fTree->Branch("roiChannels", &fRoi.channels, basketSize );
+  fTree->Branch("roiStarts", &fRoi.starts, basketSize );
+  fTree->Branch("roiOffsets", &fRoi.offsets, basketSize );
+  fTree->Branch("samples", &fRoi.samples, basketSize );
+}
+
+EntryWriter::EntryWriter( TTree* tree, NativeWriter* native, int basketSize ) : EntryWriter( tree, native, basketSize, nullptr ) {}
+
+void EntryWriter::build_events( EventBuilder* builder, TTree* eventTree, int basketSize ){
+  fBuilder = builder;
+  fEventTree = eventTree;
+  if( !fEventTree ) return;
+  // Crate channel c = (slot - first slot)*64 + FEM channel is samples[offsets[c], offsets[c+1])
+  fEventTree->Branch("event", &fEvent.event, "event/i");
+  fEventTree->Branch("frame", &fEvent.frame, "frame/i");
+  fEventTree->Branch("status", &fEvent.status, "status/i");
+  fEventTree->Branch("slots", &fEvent.slots, "slots/i");
+  fEventTree->Branch("headers", &fEvent.headers, basketSize );
+  fEventTree->Branch("samples", &fEvent.samples, basketSize );
+  fEventTree->Branch("offsets", &fEvent.offsets, basketSize );
+}
+
+void EntryWriter::write_wires( const WireOrder* wireOrder, TTree* wireTree, int basketSize ){
+  fWireOrder = wireOrder;
+  fWireTree = wireTree;
+  fPlanes.resize( fWireOrder->nplanes() ); // Not resized afterwards: the branches hold their addresses
+  fWireTree->Branch("event", &fEvent.event, "event/i");
+  fWireTree->Branch("frame", &fEvent.frame, "frame/i");
+  fWireTree->Branch("status", &fEvent.status, "status/i");
+  fWireTree->Branch("nsamples", &fNSamples, "nsamples/i");
+  for(size_t p = 0; p < fPlanes.size(); p++) fWireTree->Branch( fWireOrder->plane_name(p).c_str(), &fPlanes[p], basketSize );
+}
+
+void EntryWriter::write( FrameData& frame ){
+  // Swap instead of copying: the frame reuses the memory of the previous entry
+  fEntry.header = frame.header;
+  fEntry.nchannels = frame.nchannels;
+  fEntry.samples.swap( frame.samples );
+  fEntry.offsets.swap( frame.offsets );
+  check_frame( fEntry.header );
+  summary.add_frame( fEntry );
+  if( fStats ) fStats->add( fEntry );
+  if( fChannelMap ){
+    for(size_t ch = 0; ch < 64; ch++){
+      const ChannelMapRecord* record = fChannelMap->find( fEntry.header.slot, ch );
+      if( record && record->larWire >= 0 && fEntry.size(ch) > 0 ) fWireChannels++;
+    }
+  }
+  if( fRoiFinder ){
+    fRoiFinder->find( fEntry, fRoi, fRoiScratch );
+    fRois += fRoi.nrois();
+    fRoiSamples += fRoi.samples.size();
+    fAllSamples += fEntry.offsets[64];
+  }
+  if( fTree ) fTree->Fill();
+  if( fNative ) fNative->write( fEntry.header, fEntry.samples, fEntry.offsets );
+  fEntries++;
+  LOG_INFO( "Entry " << fEntries << " written" );
+  if( fBuilder ){
+    fBuilder->add( fEntry );
+    write_events();
+  }
+}
+
+void EntryWriter::finish(){
+  if( !fBuilder ) return;
+  fBuilder->finish();
+  write_events();
+}
+
+void EntryWriter::write_events(){
+  while( fBuilder->next( fEvent ) ){
+    if( fEventTree ) fEventTree->Fill();
+    if( fWireTree ){
+      fNSamples = fWireOrder->fill( fEvent, fPlanes );
+      fWireTree->Fill();
+    }
+    LOG_INFO( "Event " << fEvent.event << " built from " << __builtin_popcount( fEvent.slots ) << " FEMs" );
+  }
+}
+
+// Labels of the FEM channels, in the layout of the channelMapTree written by channel_mapper.exe
+static void write_channel_map( const ChannelMap& channelMap ){
+  TTree* mapTree = new TTree( "channelMapTree", "Tree with the LArIAT VST channel map" );
+  Int_t values[14];
+  char plane[16], adapterConnector[16], adchex[8];
+  const char* names[14] = {"larwire", "origwire", "adapterpin", "analogconnector", "analogpin", "asic", "asicch", "fembch", "femb", "wib", "adcdec", "slot", "femch", "key"};
+  for(size_t v = 0; v < 14; v++) mapTree->Branch( names[v], &values[v], (std::string(names[v]) + "/I").c_str() );
+  mapTree->Branch( "plane", plane, "plane/C" );
+  mapTree->Branch( "adapterconnector", adapterConnector, "adapterconnector/C" );
+  mapTree->Branch( "adchex", adchex, "adchex/C" );
+  for(size_t r = 0; r < channelMap.size(); r++){
+    const ChannelMapRecord& record = channelMap.record(r);
+    Int_t recordValues[14] = {record.larWire, record.origWire, record.adapterPin, record.analogConnector, record.analogPin, record.asic, record.asicch,
+			      record.fembch, record.femb, record.wib, record.adc, record.slot, record.femch, record.key};
+    std::copy( recordValues, recordValues + 14, values );
+    snprintf( plane, sizeof(plane), "%s", channelMap.plane( record ).c_str() );
+    snprintf( adapterConnector, sizeof(adapterConnector), "%s", channelMap.adapter_connector( record ).c_str() );
+    if( record.adc >= 0 ) snprintf( adchex, sizeof(adchex), "%X", (unsigned)record.adc );
+    else snprintf( adchex, sizeof(adchex), "NAN" );
+    mapTree->Fill();
+  }
+  mapTree->Write();
+}
 
-// Classify word
-WordType get_word_type( uint16_t word ){
-  static int headerCounter = 0; // Initialized only the first time
-  if( (word & 0xF000) == 0xF000){
-    WordType type = static_cast<WordType>( kHeaderFirst + headerCounter );
-    headerCounter++;
-    if( headerCounter == 12 ) headerCounter = 0;
-    return type;
-  }
-  if( (word & 0xF000) == 0x4000 ) return kChannelHeader;
-  if( (word & 0xF000) == 0x0000 ) return kADC; // Can also be 0x0000 padding...
-  if( (word & 0xC000) == 0x8000 ) return kADCHuffman; // Look for headers first
-  if( (word & 0xF000) == 0x5000 ) return kChannelEnding;
-  else return kUnknown;
-}
-
-// Decode Huffman
-int decode_huffman( int zeros ){
-  switch( zeros ){
-  case 0: return 0;
-  case 1: return -1;
-  case 2: return 1;
-  case 3: return -2;
-  case 4: return 2;
-  case 5: return -3;
-  case 6: return 3;
-  default:
-    std::cerr << "ERROR: Number of zeros (" << zeros << ") in Huffman word is out of bounds" << std::endl;
-    return 4096;
+// LArSoft wire of each row of the matrices of wireTree, one entry per plane
+static void write_planes( const WireOrder& wireOrder ){
+  TTree* planeTree = new TTree( "planeTree", "Wires of the planes of wireTree" );
+  char name[16];
+  std::vector<int32_t> wires;
+  std::vector<int32_t>* wiresPtr = &wires;
+  planeTree->Branch( "plane", name, "plane/C" );
+  planeTree->Branch( "wires", &wiresPtr );
+  for(size_t p = 0; p < wireOrder.nplanes(); p++){
+    snprintf( name, sizeof(name), "%s", wireOrder.plane_name(p).c_str() );
+    wires = wireOrder.wires(p);
+    planeTree->Fill();
   }
+  planeTree->Write();
+}
+
+// Noise statistics of the channels, one entry per (slot, FEM channel) with samples
+// Returns the channels written and counts those with stuck bits
+static size_t write_channel_stats( const ChannelStats& stats, TTree* statsTree, size_t& stuckChannels ){
+  Int_t slot, channel;
+  ULong64_t samples, frames;
+  Double_t pedestal, rms;
+  UShort_t minimum, maximum, stuckHigh, stuckLow;
+  if( statsTree ){
+    statsTree->Branch("slot", &slot, "slot/I");
+    statsTree->Branch("channel", &channel, "channel/I");
+    statsTree->Branch("samples", &samples, "samples/l");
+    statsTree->Branch("frames", &frames, "frames/l");
+    statsTree->Branch("pedestal", &pedestal, "pedestal/D");
+    statsTree->Branch("rms", &rms, "rms/D");
+    statsTree->Branch("min", &minimum, "min/s");
+    statsTree->Branch("max", &maximum, "max/s");
+    statsTree->Branch("stuckHigh", &stuckHigh, "stuckHigh/s"); // Bits always 1 that [min, max] says should have toggled
+    statsTree->Branch("stuckLow", &stuckLow, "stuckLow/s"); // Bits always 0 that [min, max] says should have toggled
+  }
+  size_t written = 0;
+  stuckChannels = 0;
+  for(slot = 0; slot < (Int_t)ChannelStats::kSlots; slot++){
+    for(channel = 0; channel < 64; channel++){
+      const ChannelAccumulator& acc = stats.channel( slot, channel );
+      if( acc.samples == 0 ) continue;
+      samples = acc.samples;
+      frames = acc.frames;
+      pedestal = acc.mean;
+      rms = acc.rms();
+      minimum = acc.min;
+      maximum = acc.max;
+      stuckHigh = acc.stuck_high();
+      stuckLow = acc.stuck_low();
+      if( stuckHigh || stuckLow ) stuckChannels++;
+      if( statsTree ) statsTree->Fill();
+      written++;
+    }
+  }
+  if( statsTree ) statsTree->Write();
+  return written;
+}
+
+// Serial decoding of a stream of 32-bit words, which may arrive in pieces
+// A frame is written when the next one starts, or earlier by flush_complete()
+class StreamDecoder{
+public:
+  StreamDecoder( EntryWriter& writer ) : fWriter(writer) {};
+  void add_words( const uint32_t* words, size_t nwords );
+  bool flush_complete(); // Write the current frame if all its words have arrived
+  void finish(); // Write the last frame (might be incomplete)
+
+private:
+  void write_frame();
+
+  EntryWriter& fWriter;
+  DecoderState fState;
+  FrameData fFrame;
+  size_t fEntry = 0; // Frames started so far
+  bool fWritten = false; // The current frame was already written by flush_complete()
+  size_t fLateWords = 0; // Data words of the current frame that arrived after it was written
+};
+
+void StreamDecoder::add_words( const uint32_t* words, size_t nwords ){
+  for(size_t w = 0; w < nwords; w++){
+    uint32_t word32b = words[w];
+    if( is_xmit_word( word32b ) ){ // Temporary: ignore XMIT words
+      LOG_INFO( "INFO: XMIT word " << std::hex << std::setfill('0') << std::setw(8) << word32b << " found and ignored" );
+      fWriter.summary.xmitWords++;
+      continue;
+    }
+    uint16_t first16b = word32b & 0xFFFF;
+    uint16_t last16b = (word32b>>16) & 0xFFFF;
+    uint16_t words16b[2] = {first16b, last16b};
+
+    for(size_t i = 0; i < 2; i++){
+      // The beginning of a new entry triggers the filling of the last one
+      if( is_frame_start( words16b[i], fState ) ){
+	if( fEntry > 0 && !fWritten ) write_frame();
+	if( fLateWords > 0 ) LOG_WARNING( "WARNING: " << fLateWords << " words arrived after entry " << fEntry << " was written and were dropped" );
+	fWritten = false;
+	fLateWords = 0;
+	fEntry++;
+	LOG_INFO( "Beginning to process entry " << fEntry );
+      }
+      uint32_t wordcount = fFrame.header.wordcount;
+      decode_word( words16b[i], fState, fFrame );
+      if( fWritten && fFrame.header.wordcount != wordcount ) fLateWords++; // Padding is fine
+    } // end of loop over 2 words
+  }
+}
+
+bool StreamDecoder::flush_complete(){
+  if( fEntry == 0 || fWritten ) return false;
+  // All 12 header words, no channel being read, and as many words as the header announces
+  if( fState.headerCounter != 0 || fState.currentChannel != 999 ) return false;
+  if( (fFrame.header.wordcount & 0xFFFFFF) < fFrame.header.nwords ) return false;
+  write_frame();
+  fWritten = true;
+  return true;
+}
+
+void StreamDecoder::finish(){
+  if( !fWritten ) write_frame();
+  if( fLateWords > 0 ) LOG_WARNING( "WARNING: " << fLateWords << " words arrived after entry " << fEntry << " was written and were dropped" );
+}
+
+void StreamDecoder::write_frame(){
+  fFrame.pack();
+  fWriter.write( fFrame );
+}
+
+// Decode the frames on a pool of worker threads and fill the tree in file order
+// Workers decode into a ring of slots; the calling thread is the only one touching the tree
+static void decode_parallel( const MappedFile& binFile, unsigned nthreads, EntryWriter& writer ){
+  std::vector<FrameSpan> spans = scan_frames( binFile.words(), binFile.nwords(), &writer.summary.xmitWords );
+  const size_t nframes = spans.size();
+  const size_t nslots = 4*nthreads; // Bounds the number of decoded frames waiting to be written
+  LOG_INFO( "INFO: Decoding " << nframes << " frames with " << nthreads << " threads" );
+
+  std::vector<FrameData> slots(nslots);
+  std::vector<size_t> ready(nslots, nframes); // Index of the frame decoded in each slot (nframes: none)
+  size_t written = 0; // Frames already in the tree
+  std::atomic<size_t> next(0); // Next frame to decode
+  std::mutex mutex;
+  std::condition_variable cond;
+
+  std::vector<std::thread> workers;
+  for(unsigned t = 0; t < nthreads; t++){
+    workers.emplace_back( [&](){
+	for(size_t i = next++; i < nframes; i = next++){
+	  size_t slot = i % nslots;
+	  {
+	    std::unique_lock<std::mutex> lock(mutex);
+	    cond.wait( lock, [&]{ return i < written + nslots; } ); // Wait until the slot has been written
+	  }
+	  decode_frame( binFile.words(), spans[i], slots[slot] );
+	  {
+	    std::lock_guard<std::mutex> lock(mutex);
+	    ready[slot] = i;
+	  }
+	  cond.notify_all();
+	}
+      } );
+  }
+
+  for(size_t i = 0; i < nframes; i++){
+    size_t slot = i % nslots;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      cond.wait( lock, [&]{ return ready[slot] == i; } );
+    }
+    writer.write( slots[slot] );
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      ready[slot] = nframes;
+      written = i + 1;
+    }
+    cond.notify_all();
+  }
+  for(size_t t = 0; t < workers.size(); t++) workers[t].join();
+}
+
+static volatile sig_atomic_t gStopFollowing = 0;
+static void stop_following( int ){ gStopFollowing = 1; }
+
+// Decode a file while it is being written (e.g. by the DAQ), until it stops growing or on Ctrl-C
+// Complete frames are written as soon as they arrive and the trees are saved to disk every autosaveInterval
+// Returns the number of bytes read
+static size_t decode_follow( int fd, const DecoderOptions& options, StreamDecoder& stream, const std::vector<TTree*>& outTrees ){
+  TTree* outTree = outTrees.empty() ? nullptr : outTrees[0]; // decoderTree, then the trees of crate events
+  const size_t chunkBytes = 4 << 20; // Memory used for reading, whatever the file size
+  const std::chrono::milliseconds pollInterval(100);
+  std::vector<uint32_t> buffer( chunkBytes/sizeof(uint32_t) );
+  char* bytes = reinterpret_cast<char*>( buffer.data() );
+  size_t carry = 0; // Bytes of an incomplete 32-bit word kept at the beginning of the buffer
+  size_t total = 0;
+  size_t savedEntries = 0;
+  std::chrono::steady_clock::time_point lastData = std::chrono::steady_clock::now();
+  std::chrono::steady_clock::time_point lastSave = lastData;
+
+  gStopFollowing = 0;
+  std::signal( SIGINT, stop_following );
+  LOG_INFO( "INFO: Following file (Ctrl-C to stop, or after " << options.followTimeout << " s without new data)" );
+  while( !gStopFollowing ){
+    ssize_t got = ::read( fd, bytes + carry, chunkBytes - carry );
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if( got > 0 ){
+      total += got;
+      size_t available = carry + got;
+      size_t nwords = available/sizeof(uint32_t);
+      stream.add_words( buffer.data(), nwords );
+      carry = available - nwords*sizeof(uint32_t);
+      std::memmove( bytes, bytes + nwords*sizeof(uint32_t), carry );
+      lastData = now;
+    }
+    else if( got == 0 || errno == EINTR ){ // No new data for now
+      stream.flush_complete();
+      log_flush();
+      if( std::chrono::duration<double>( now - lastData ).count() > options.followTimeout ) break;
+      std::this_thread::sleep_for( pollInterval );
+    }
+    else{
+      LOG_ERROR( "ERROR: Reading the file failed: " << std::strerror(errno) );
+      break;
+    }
+    // Make the new entries readable by other processes
+    if( outTree && outTree->GetEntries() > (Long64_t)savedEntries && std::chrono::duration<double>( now - lastSave ).count() >= options.autosaveInterval ){
+      for(size_t t = 0; t < outTrees.size(); t++) outTrees[t]->AutoSave("SaveSelf");
+      savedEntries = outTree->GetEntries();
+      lastSave = now;
+      LOG_INFO( "INFO: " << savedEntries << " entries saved to disk" );
+    }
+  }
+  std::signal( SIGINT, SIG_DFL );
+  if( carry > 0 ) LOG_WARNING( "WARNING: The last " << carry << " bytes do not make a 32-bit word and are ignored" );
+  return total;
+}
+
+// Check the word count and checksum of every frame without decoding the samples, and print one line per frame
+// (only the failing frames in quiet mode). Returns 1 if all frames pass, 0 otherwise
+static int verify_only( const std::string& inFileName, const MappedFile& binFile, const DecoderOptions& options, unsigned nthreads, RunSummary& summary ){
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  std::vector<FrameSpan> spans = scan_frames( binFile.words(), binFile.nwords() );
+  std::vector<FrameCheck> checks = verify_frames( binFile.words(), spans, nthreads );
+  summary.seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+  summary.inputBytes = binFile.size();
+  summary.frames = checks.size();
+
+  // The table is written in one piece, as several files may be verified at the same time
+  std::ostringstream table;
+  size_t failed = 0;
+  table << std::setw(10) << "Frame" << std::setw(14) << "Byte offset" << std::setw(10) << "Event" << std::setw(10) << "FrameNo"
+	<< std::setw(6) << "Slot" << std::setw(10) << "NWords" << std::setw(10) << "Counted"
+	<< std::setw(10) << "Checksum" << std::setw(10) << "Computed" << "  Status\n";
+  for(size_t i = 0; i < checks.size(); i++){
+    const FrameCheck& check = checks[i];
+    const HeaderInfo& h = check.header;
+    if( !check.words_ok() ) summary.wordCountMismatches++;
+    if( !check.checksum_ok() ) summary.checksumMismatches++;
+    if( !check.ok() ) failed++;
+    summary.xmitWords += check.xmitWords;
+    if( options.quiet && check.ok() ) continue;
+    table << std::dec << std::setw(10) << i << std::setw(14) << 2*check.begin << std::setw(10) << h.event << std::setw(10) << h.frame
+	  << std::setw(6) << (int)h.slot << std::setw(10) << h.nwords << std::setw(10) << h.wordcount
+	  << std::hex << std::setw(10) << h.checksum << std::setw(10) << h.mychecksum
+	  << (check.ok() ? "  PASS" : (check.words_ok() ? "  FAIL checksum" : (check.checksum_ok() ? "  FAIL nwords" : "  FAIL nwords checksum"))) << '\n';
+  }
+  double megabytes = summary.inputBytes/1.e6;
+  table << std::dec << "Verification of " << inFileName << ":\n"
+	<< "  Frames: " << summary.frames << "\n"
+	<< "  Failed frames: " << failed << "\n"
+	<< "  Word-count mismatches: " << summary.wordCountMismatches << "\n"
+	<< "  Checksum mismatches: " << summary.checksumMismatches << "\n"
+	<< "  XMIT words skipped: " << summary.xmitWords << "\n"
+	<< "  Verified " << megabytes << " MB in " << summary.seconds << " s (" << megabytes/summary.seconds << " MB/s, "
+	<< nthreads << " threads)\n";
+  std::cout << table.str() << std::flush;
+  return (failed == 0) ? 1 : 0;
+}
+
+// Write the frame index sidecar of a binary file. Returns 1 on success
+static int index_only( const std::string& inFileName, const MappedFile& binFile, unsigned nthreads, RunSummary& summary ){
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  FrameIndex index;
+  index.build( binFile, nthreads );
+  std::string indexName = FrameIndex::sidecar_name( inFileName );
+  if( !index.save( indexName, inFileName ) ){
+    std::cerr << "ERROR: Could not create file " << indexName << std::endl;
+    return 0;
+  }
+  size_t failed = 0;
+  for(size_t i = 0; i < index.size(); i++) failed += !index.ok(i);
+  summary.seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+  summary.inputBytes = binFile.size();
+  summary.frames = index.size();
+  std::ostringstream report;
+  report << "Index of " << inFileName << " written to " << indexName << ":\n"
+	 << "  Frames: " << index.size() << "\n"
+	 << "  Failed frames: " << failed << "\n"
+	 << "  Indexed " << summary.inputBytes/1.e6 << " MB in " << summary.seconds << " s\n";
+  std::cout << report.str() << std::flush;
+  return 1;
 }
 
 // Loop over a binary file, interpret words and write them to a ROOT file
 //int main( int argc, char** argv ){
 int decoder( const char* argv ){
+  return decoder( argv, DecoderOptions() );
+}
+
+int decoder( const char* argv, const DecoderOptions& options, RunSummary* runSummary ){
   //  std::string inFileName = argv[1];
   std::string inFileName(argv);
 
-  std::ifstream binFile;
-  binFile.open( inFileName.c_str(), std::ios::binary );
-  if( !binFile.is_open() ){
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  if( options.quiet ) set_log_level( kError );
+
+  // Zero-copy view of the whole file: memory-mapped, or read in large blocks as a fallback
+  // A file that is still being written is read as it grows instead
+  MappedFile binFile;
+  int followFd = options.follow ? ::open( inFileName.c_str(), O_RDONLY ) : -1;
+  if( options.follow ? (followFd < 0) : !binFile.open( inFileName ) ){
     std::cerr << "ERROR: Could not open file " << inFileName << std::endl;
     return 0;
   }
 
-  std::string outFileName = inFileName.substr(0, inFileName.find_last_of(".")) + ".root";
-  TFile rootFile( outFileName.c_str(), "RECREATE" );
-
-  // Header information
-  HeaderInfo header;
-  // Matrix of waveforms: 64 channels x N samples
-  std::vector< std::vector<uint16_t> > waveform;
-  waveform.resize(64);
-  size_t currentChannel = 999;
-  std::vector<uint16_t> currentWaveform;
-
-  TTree* outTree = new TTree("decoderTree", "Decoder output tree");
-  outTree->Branch("header", &header );
-  outTree->Branch("waveform", &waveform );
-
-  int entry = 0;
-  while( binFile.peek() != EOF ){
-    uint32_t word32b;
-    binFile.read( reinterpret_cast<char*>(&word32b), sizeof(word32b) );
-    if( (word32b == 0xFFFFFFFF) || (word32b == 0xE0000000) ){ // Temporary: ignore XMIT words
-      std::cout << std::setfill('0');
-      std::cout << "INFO: XMIT word " << std::hex << std::setw(8) << word32b << " found and ignored" <<  std::endl;
-      std::cout << std::dec; // revert to decimal
-      continue;
+  unsigned nthreads = options.threads;
+  if( nthreads == 0 ) nthreads = std::max( 1u, std::thread::hardware_concurrency() );
+  RunSummary checkSummary;
+  int status = -1;
+  if( options.verifyOnly && !options.follow ) status = verify_only( inFileName, binFile, options, nthreads, checkSummary );
+  else if( options.indexOnly && !options.follow ) status = index_only( inFileName, binFile, nthreads, checkSummary );
+  if( status >= 0 ){
+    if( runSummary ) *runSummary = checkSummary;
+    return status;
+  }
+
+  // ROOT and/or native output
+  std::string outBaseName = inFileName.substr(0, inFileName.find_last_of("."));
+  std::unique_ptr<TFile> rootFile;
+  TTree* outTree = nullptr;
+  if( options.rootOutput ){
+    rootFile.reset( new TFile( (outBaseName + ".root").c_str(), "RECREATE" ) );
+    if( options.compression >= 0 ) rootFile->SetCompressionSettings( options.compression );
+    if( options.imtThreads > 0 && !ROOT::IsImplicitMTEnabled() ) ROOT::EnableImplicitMT( options.imtThreads ); // Baskets are compressed in parallel
+    outTree = options.roi ? new TTree("roiTree", "Regions of interest of the decoded frames") : new TTree("decoderTree", "Decoder output tree");
+    // Baskets go to disk every autoFlush, so memory does not grow with the run
+    if( options.autoFlush != 0 ) outTree->SetAutoFlush( options.autoFlush );
+    if( options.autoSave != 0 ) outTree->SetAutoSave( options.autoSave );
+  }
+  NativeWriter nativeFile;
+  if( options.nativeOutput && !nativeFile.open( outBaseName + ".ndf" ) ){
+    std::cerr << "ERROR: Could not create file " << outBaseName << ".ndf" << std::endl;
+    return 0;
+  }
+  // Zero suppression
+  RoiFinder roiFinder( options.roiThreshold, options.roiPre, options.roiPost );
+  std::string roiError;
+  if( options.roi && !options.roiThresholdFile.empty() && !roiFinder.read_thresholds( options.roiThresholdFile, roiError ) ){
+    std::cerr << "ERROR: " << roiError << std::endl;
+    return 0;
+  }
+  EntryWriter writer( outTree, options.nativeOutput ? &nativeFile : nullptr, options.basketSize > 0 ? options.basketSize : 32000,
+		      options.roi ? &roiFinder : nullptr );
+  ChannelMap channelMap;
+  if( !options.channelMapFile.empty() ){
+    std::chrono::steady_clock::time_point mapStart = std::chrono::steady_clock::now();
+    if( !channelMap.load( options.channelMapFile ) ){
+      std::cerr << "ERROR: Could not read channel map " << options.channelMapFile << std::endl;
+      return 0;
     }
-    uint16_t first16b = word32b & 0xFFFF;
-    uint16_t last16b = (word32b>>16) & 0xFFFF;
-    uint16_t words16b[2] = {first16b, last16b};
+    double mapSeconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - mapStart ).count();
+    LOG_INFO( "INFO: Channel map of " << channelMap.size() << " channels read from " << options.channelMapFile << " in " << 1e6*mapSeconds << " us" );
+    writer.set_channel_map( &channelMap );
+  }
+  ChannelStats channelStats;
+  if( options.channelStats ) writer.set_channel_stats( &channelStats );
+  std::vector<TTree*> outTrees;
+  if( outTree ) outTrees.push_back( outTree );
+  std::unique_ptr<EventBuilder> builder;
+  TTree* eventTree = nullptr;
+  if( options.buildEvents || options.wireOrder ){ // Wire order works on crate events, but eventTree is only written when asked for
+    builder.reset( new EventBuilder( options.crateFirstSlot, options.crateSlots, options.eventWindow ) );
+    if( rootFile && options.buildEvents ){
+      eventTree = new TTree("eventTree", "Crate events");
+      outTrees.push_back( eventTree );
+    }
+    writer.build_events( builder.get(), eventTree, options.basketSize > 0 ? options.basketSize : 32000 );
+  }
+  // Waveforms of each crate event in wire order, one matrix per plane
+  WireOrder wireOrder;
+  if( options.wireOrder ){
+    if( !wireOrder.build( channelMap, options.crateFirstSlot, options.crateSlots ) ){
+      std::cerr << "ERROR: No channel of the crate is connected to a wire in " << options.channelMapFile << std::endl;
+      return 0;
+    }
+    TTree* wireTree = new TTree("wireTree", "Crate events in LArSoft wire order");
+    outTrees.push_back( wireTree );
+    writer.write_wires( &wireOrder, wireTree, options.basketSize > 0 ? options.basketSize : 32000 );
+  }
+  for(size_t t = 1; t < outTrees.size(); t++){
+    if( options.autoFlush != 0 ) outTrees[t]->SetAutoFlush( options.autoFlush );
+    if( options.autoSave != 0 ) outTrees[t]->SetAutoSave( options.autoSave );
+  }
 
-    for(size_t i = 0; i < 2; i++){
-      uint16_t word = words16b[i];
-      std::string type;
-      switch( get_word_type( word ) ){
-      case kHeaderFirst:
-	type = "Header First";
-	if(entry > 0){
-	  // The beginning of a new entry triggers the filling of the last one
-	  header.wordcount = (header.wordcount & 0xFFFFFF);
-	  int32_t nwords_diff = header.nwords - header.wordcount;
-	  if( nwords_diff != 0 ) std::cerr << "WARNING: Word count difference: " << nwords_diff << std::endl;
-	  header.mychecksum = (header.mychecksum & 0xFFFFFF);
-	  uint32_t checksum_diff = header.checksum - header.mychecksum;
-	  if( checksum_diff != 0 ) std::cerr << "WARNING: Checksum difference: " << checksum_diff << std::endl;
-	  outTree->Fill();
-	  std::cout << "Entry " << entry << " written to TTree" <<  std::endl;
-	}
-	// Reset
-	header.clear();
-	for(size_t ch = 0; ch < 64; ch++){
-	  waveform[ch].clear();
-	}
-	entry++;
-	std::cout << "Beginning to process entry " << entry << std::endl;
-	break;
-      case kHeaderIDSlot:
-	type = "Header ID+Slot";
-	header.slot = (word & 0x1F);
-	header.id = ((word>>5) & 0xF);
-	header.test = ((word>>9) & 0x1);
-	header.overflow = ((word>>10) & 0x1);
-	header.full = ((word>>11) & 0x1);
-	std::cout << "FEM " << (int)header.slot << std::endl;
-	break;
-      case kHeaderNWordsMSB:
-	type = "Header N Words MSB";
-	header.nwords += ((word & 0xFFF)<<12);
-	break;
-      case kHeaderNWordsLSB:
-	type = "Header N Words LSB";
-	header.nwords += (word & 0xFFF);
-	break;
-      case kHeaderEventMSB:
-	type = "Header Event MSB";
-	header.event += ((word & 0xFFF)<<12);
-	break;
-      case kHeaderEventLSB:
-	type = "Header Event LSB";
-	header.event += (word & 0xFFF);
-	std::cout << "Event " << (int)header.event << std::endl;
-	break;
-      case kHeaderFrameMSB:
-	type = "Header Frame MSB";
-	header.frame += ((word & 0xFFF)<<12);
-	break;
-      case kHeaderFrameLSB:
-	type = "Header Frame LSB";
-	header.frame += (word & 0xFFF);
-	std::cout << "Frame " << (int)header.frame << std::endl;
-	break;
-      case kHeaderChecksumMSB:
-	type = "Header Checksum MSB";
-	header.checksum += ((word & 0xFFF)<<12);
-	break;
-      case kHeaderChecksumLSB:
-	type = "Header Checksum LSB";
-	header.checksum += (word & 0xFFF);
-	break;
-      case kHeaderSampleMSB:
-	type = "Header Sample MSB";
-	header.triggerframe = ((word >> 4) & 0xF);
-	header.triggersample += ((word & 0xF)<<8);
-	break;
-      case kHeaderSampleLSB:
-	type = "Header Sample LSB";
-	header.triggersample += (word & 0xFF);
-	break;
-      case kChannelHeader:
-	type = "Channel Header";
-	header.wordcount++;
-	header.mychecksum += word;
-	currentChannel = (word & 0x3F);
-	currentWaveform.clear();
-	std::cout << "Reading channel " << currentChannel << std::endl;
-	break;
-      case kADC:
-	if( currentChannel != 999 ){
-	  type = "ADC";
-	  header.wordcount++;
-	  header.mychecksum += word;
-	  currentWaveform.push_back( (word & 0xFFF) );
-	  //std::cout << "ADC value " << (word & 0xFFF) << std::endl;
-	} else type = "Padding";
-	break;
-      case kADCHuffman: { // Brackets needed to declare variables
-	type = "ADC Huffman";
-	header.wordcount++;
-	header.mychecksum += word;
-	int zeros = 0; // Counter of 0s interleaved between 1s
-	std::vector<int> differences; // Vector with Huffman-decoded differences
-	differences.reserve(14); // Speed up: reserve for the maximum number of differences stored in a Huffman word
-	// Read the lowest 14 bits from left to right
-	for(uint16_t mask = 0x2000; mask > 0x0; mask = (mask>>1)){
-	  if( (word & mask) == mask ){ // Found 1
-	    differences.push_back( decode_huffman(zeros) );
-	    zeros = 0; // Reset counter
-	  } else zeros++;
-	}
-	// Differences are time-ordered from right to left
-	for(size_t i = differences.size(); i > 0; i--){
-	  currentWaveform.push_back( currentWaveform.back() + differences[i - 1] );
-	}
-	differences.clear();
-      }	break;
-      case kChannelEnding:
-	type = "Channel Ending";
-	header.wordcount++;
-	header.mychecksum += word;
-	if( (word & 0x3F) == currentChannel ){
-	  waveform[currentChannel] = currentWaveform;
-	  std::cout << "Finished reading channel " << currentChannel << std::endl;
-	}
-	else std::cerr << "ERROR: Channel header " << currentChannel << " and ending " << (word & 0x3F) << " do not match" << std::endl;
-	// Reset
-	currentChannel = 999;
-	currentWaveform.clear();
-	break;
-      case kUnknown:
-	header.wordcount++;
-	header.mychecksum += word;
-	type = "Unknown";
-	break;
-      } // end of switch
-      //std::cout << std::setfill('0');
-      //std::cout << std::hex << std::setw(4) << words16b[i] << " is " << type <<  std::endl;
-      //std::cout << std::dec; // revert to decimal
-    } // end of loop over 2 words
-  } // end of reading the file
-  // Write the last entry (might be incomplete)
-  header.wordcount = (header.wordcount & 0xFFFFFF);
-  int32_t nwords_diff = header.nwords - header.wordcount;
-  if( nwords_diff != 0 ) std::cerr << "WARNING: Word count difference: " << nwords_diff << std::endl;
-  header.mychecksum = (header.mychecksum & 0xFFFFFF);
-  uint32_t checksum_diff = header.checksum - header.mychecksum;
-  if( checksum_diff != 0 ) std::cerr << "WARNING: Checksum difference: " << checksum_diff << std::endl;
-  outTree->Fill();
+  size_t inputBytes = binFile.size();
+  std::string inputMode = binFile.is_mapped() ? "memory-mapped" : "block-read";
+  if( options.follow ){
+    StreamDecoder stream( writer );
+    inputBytes = decode_follow( followFd, options, stream, outTrees );
+    stream.finish();
+    ::close( followFd );
+    inputMode = "followed";
+  }
+  else if( nthreads > 1 ) decode_parallel( binFile, nthreads, writer );
+  else{
+    StreamDecoder stream( writer );
+    stream.add_words( binFile.words(), binFile.nwords() );
+    stream.finish();
+  }
+  writer.finish();
 
+  size_t stuckChannels = 0;
+  if( rootFile ){
+    for(size_t t = 0; t < outTrees.size(); t++) outTrees[t]->Write();
+    if( !options.channelMapFile.empty() ) write_channel_map( channelMap );
+    if( options.wireOrder ) write_planes( wireOrder );
+    if( options.channelStats ) write_channel_stats( channelStats, new TTree("channelStatsTree", "Pedestal and noise of each channel"), stuckChannels );
+    rootFile->Close();
+  }
+  if( !nativeFile.close() ){
+    // Incomplete: removed, so a batch run does not take it for up to date
+    std::cerr << "ERROR: Could not write file " << outBaseName << ".ndf" << std::endl;
+    std::remove( (outBaseName + ".ndf").c_str() );
+    binFile.close();
+    return 0;
+  }
+
+  // Run summary, also printed in quiet mode (in one piece, as several files may be decoded at the same time)
+  log_flush();
+  RunSummary& summary = writer.summary;
+  summary.seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+  summary.inputBytes = inputBytes;
+  double megabytes = inputBytes/1.e6;
+  std::ostringstream report;
+  report << "Run summary for " << inFileName << ":\n"
+	 << "  Frames: " << summary.frames << "\n"
+	 << "  Channels: " << summary.channels << "\n"
+	 << "  Word-count mismatches: " << summary.wordCountMismatches << "\n"
+	 << "  Checksum mismatches: " << summary.checksumMismatches << "\n"
+	 << "  XMIT words skipped: " << summary.xmitWords << "\n"
+	 << "  Decoded " << megabytes << " MB in " << summary.seconds << " s (" << megabytes/summary.seconds << " MB/s, "
+	 << inputMode << " input)\n";
+  if( options.roi ){
+    report << "  Regions of interest: " << writer.rois() << ", " << writer.roi_samples() << " of " << writer.all_samples() << " samples kept ("
+	   << (writer.all_samples() > 0 ? 100.*writer.roi_samples()/writer.all_samples() : 0.) << "%)\n";
+  }
+  if( options.channelStats ){
+    if( !rootFile ) write_channel_stats( channelStats, nullptr, stuckChannels );
+    // Spread of the noise over the channels
+    std::vector<double> rms;
+    for(size_t c = 0; c < ChannelStats::kSlots*64; c++){
+      if( channelStats.channel( c/64, c%64 ).samples > 0 ) rms.push_back( channelStats.channel( c/64, c%64 ).rms() );
+    }
+    std::sort( rms.begin(), rms.end() );
+    report << "  Channel statistics: " << rms.size() << " channels, RMS median " << (rms.empty() ? 0. : rms[rms.size()/2])
+	   << " (max " << (rms.empty() ? 0. : rms.back()) << "), " << stuckChannels << " with stuck bits\n";
+  }
+  if( !options.channelMapFile.empty() ) report << "  Channels on wires: " << writer.wire_channels() << " (channel map " << options.channelMapFile << ")\n";
+  if( builder ){
+    const EventBuilderSummary& events = builder->summary();
+    report << "  Crate events: " << events.events << " (" << events.completeEvents << " complete, " << events.incompleteEvents << " with FEMs missing, "
+	   << events.desyncEvents << " desync)\n"
+	   << "  Frames reordered: " << events.reorderedFrames << ", dropped: " << events.lateFrames << " late, "
+	   << events.duplicateFrames << " duplicate, " << events.foreignFrames << " outside the crate\n";
+  }
+  if( rootFile ){
+    struct stat st;
+    if( stat( (outBaseName + ".root").c_str(), &st ) == 0 ){
+      report << "  ROOT file: " << st.st_size/1.e6 << " MB (compression " << (options.compression >= 0 ? std::to_string( options.compression ) : "default")
+	     << ", ratio " << (st.st_size > 0 ? (double)inputBytes/st.st_size : 0.) << ")\n";
+    }
+  }
+  std::cout << report.str() << std::flush;
+  if( runSummary ) *runSummary = summary;
   binFile.close();
-  outTree->Write();
-  rootFile.Close();
   return 1;
 }
 
+// ROOT compression setting
+int compression_setting( const std::string& spec ){
+  std::string algorithm = spec.substr( 0, spec.find(':') );
+  int level = (spec.find(':') != std::string::npos) ? std::atoi( spec.substr( spec.find(':') + 1 ).c_str() ) : -1;
+  // ROOT algorithm numbers, and the level used when none is given
+  const char* names[5] = {"none", "zlib", "lzma", "lz4", "zstd"};
+  const int numbers[5] = {0, 1, 2, 4, 5};
+  const int levels[5] = {0, 1, 1, 4, 5};
+  for(size_t a = 0; a < 5; a++){
+    if( algorithm != names[a] ) continue;
+    if( numbers[a] == 0 ) return 0;
+    if( level < 0 ) level = levels[a];
+    return (level >= 1 && level <= 9) ? 100*numbers[a] + level : -1;
+  }
+  return -1;
+}
+
+// Modification time of a file, or -1 if it does not exist
+static time_t modification_time( const std::string& fileName ){
+  struct stat st;
+  return (stat( fileName.c_str(), &st ) == 0) ? st.st_mtime : -1;
+}
+
+// True if every output decoder() would write for this file exists and is not older than the file
+static bool up_to_date( const std::string& inFileName, const DecoderOptions& options ){
+  if( options.verifyOnly ) return false; // Nothing is written
+  std::string outBaseName = inFileName.substr(0, inFileName.find_last_of("."));
+  std::vector<std::string> outputs;
+  if( options.indexOnly ) outputs.push_back( FrameIndex::sidecar_name( inFileName ) );
+  else{
+    if( options.rootOutput ) outputs.push_back( outBaseName + ".root" );
+    if( options.nativeOutput ) outputs.push_back( outBaseName + ".ndf" );
+  }
+  time_t input = modification_time( inFileName );
+  for(size_t o = 0; o < outputs.size(); o++){
+    if( modification_time( outputs[o] ) < input ) return false;
+  }
+  return true;
+}
+
+// Decode several files on a pool of jobs
+int decode_batch( const std::vector<std::string>& inFileNames, const DecoderOptions& options, unsigned jobs, bool force ){
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  unsigned cores = std::max( 1u, std::thread::hardware_concurrency() );
+  unsigned threadsPerJob = (options.threads == 0) ? cores : options.threads;
+  if( jobs == 0 ) jobs = std::max( 1u, cores/threadsPerJob ); // Decoding is limited by the cores before the disks
+  if( options.quiet ) set_log_level( kError );
+
+  // Largest files first, so the last jobs to finish are short ones
+  std::vector<std::pair<size_t, std::string> > queue;
+  size_t skipped = 0;
+  for(size_t f = 0; f < inFileNames.size(); f++){
+    // A file given twice (e.g. by name and by pattern) would be written by two jobs at once
+    if( std::find( inFileNames.begin(), inFileNames.begin() + f, inFileNames[f] ) != inFileNames.begin() + f ) continue;
+    struct stat st;
+    if( stat( inFileNames[f].c_str(), &st ) != 0 ) queue.push_back( std::make_pair( 0, inFileNames[f] ) ); // decoder() reports it
+    else if( !force && up_to_date( inFileNames[f], options ) ){
+      LOG_INFO( "INFO: Skipping " << inFileNames[f] << " (outputs are up to date)" );
+      skipped++;
+    }
+    else queue.push_back( std::make_pair( (size_t)st.st_size, inFileNames[f] ) );
+  }
+  std::sort( queue.begin(), queue.end(), []( const std::pair<size_t, std::string>& a, const std::pair<size_t, std::string>& b ){ return a.first > b.first; } );
+  jobs = std::min<size_t>( jobs, std::max<size_t>( 1, queue.size() ) );
+  LOG_INFO( "INFO: Decoding " << queue.size() << " files with " << jobs << " jobs of " << threadsPerJob << " threads" );
+  log_flush();
+
+  ROOT::EnableThreadSafety(); // Each job writes its own TFile
+  if( options.imtThreads > 0 ) ROOT::EnableImplicitMT( options.imtThreads ); // One pool shared by all jobs
+  RunSummary total;
+  std::vector<std::string> failed;
+  std::mutex mutex;
+  std::atomic<size_t> next(0);
+  auto work = [&](){
+    for(size_t f = next++; f < queue.size(); f = next++){
+      RunSummary summary;
+      int status = decoder( queue[f].second.c_str(), options, &summary );
+      log_flush();
+      std::lock_guard<std::mutex> lock(mutex);
+      total.add_run( summary );
+      if( status != 1 ) failed.push_back( queue[f].second );
+    }
+  };
+  std::vector<std::thread> workers;
+  for(unsigned j = 1; j < jobs; j++) workers.emplace_back( work );
+  work();
+  for(size_t j = 0; j < workers.size(); j++) workers[j].join();
+
+  double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+  double megabytes = total.inputBytes/1.e6;
+  std::cout << "Batch summary:\n"
+	    << "  Files: " << queue.size() + skipped << " (" << queue.size() - failed.size() << " done, "
+	    << skipped << " up to date, " << failed.size() << " failed)\n"
+	    << "  Frames: " << total.frames << "\n"
+	    << "  Channels: " << total.channels << "\n"
+	    << "  Word-count mismatches: " << total.wordCountMismatches << "\n"
+	    << "  Checksum mismatches: " << total.checksumMismatches << "\n"
+	    << "  XMIT words skipped: " << total.xmitWords << "\n"
+	    << "  Decoded " << megabytes << " MB in " << seconds << " s (" << megabytes/seconds << " MB/s aggregate, "
+	    << jobs << " jobs)" << std::endl;
+  for(size_t f = 0; f < failed.size(); f++){
+    if( options.verifyOnly ) std::cerr << "WARNING: " << failed[f] << " has frames that failed the verification" << std::endl;
+    else std::cerr << "ERROR: Decoding " << failed[f] << " failed" << std::endl;
+  }
+  return failed.empty() ? 1 : 0;
+}
+
+// Files matching a pattern that the shell did not expand (e.g. quoted "run_*.dat"), or the name itself
+static void expand_pattern( const std::string& pattern, std::vector<std::string>& fileNames ){
+  glob_t matches;
+  if( pattern.find_first_of("*?[") != std::string::npos && glob( pattern.c_str(), 0, nullptr, &matches ) == 0 ){
+    for(size_t m = 0; m < matches.gl_pathc; m++) fileNames.push_back( matches.gl_pathv[m] );
+    globfree( &matches );
+  }
+  else fileNames.push_back( pattern );
+}
+
 // To run as a standalone application
 # ifndef __CINT__
+static void print_usage(){
+  std::cerr << "Usage ./decoder.exe [--threads N] [--quiet] [--format F] [--follow] NEVIS_TPC_BINARY_FILE.dat" << std::endl;
+  std::cerr << "      ./decoder.exe --verify-only [--threads N] [--quiet] NEVIS_TPC_BINARY_FILE.dat" << std::endl;
+  std::cerr << "      ./decoder.exe --index [--threads N] NEVIS_TPC_BINARY_FILE.dat" << std::endl;
+  std::cerr << "      ./decoder.exe [options] [--jobs N] [--force] [--list FILE] NEVIS_TPC_BINARY_FILE.dat... (batch)" << std::endl;
+  std::cerr << "      ./decoder.exe --check-huffman" << std::endl;
+  std::cerr << "      ./decoder.exe --check-encoder" << std::endl;
+  std::cerr << "      ./decoder.exe --check-channel-stats" << std::endl;
+  std::cerr << "  --threads N      Decode FEM frames on N threads (0: one per core, default 1)" << std::endl;
+  std::cerr << "  --quiet          Only print errors and the run summary" << std::endl;
+  std::cerr << "  --format F       Output format: root (default), native or both" << std::endl;
+  std::cerr << "  --follow         Decode the file while the DAQ writes it" << std::endl;
+  std::cerr << "  --follow-timeout S  Stop following after S s without new data (default 60)" << std::endl;
+  std::cerr << "  --autosave S     Save the tree to disk at most every S s while following (default 0.5)" << std::endl;
+  std::cerr << "  --compression C  Compression of the ROOT file: none, zlib, lzma, lz4 or zstd, with an optional :LEVEL (e.g. lz4:4)" << std::endl;
+  std::cerr << "  --basket-size B  Bytes per basket of each branch (default 32000)" << std::endl;
+  std::cerr << "  --auto-flush N   Flush baskets every N entries (N > 0) or N bytes (N < 0) (default: ROOT's, -30000000)" << std::endl;
+  std::cerr << "  --auto-save N    Save the tree header every N entries (N > 0) or N bytes (N < 0) (default: ROOT's, -300000000)" << std::endl;
+  std::cerr << "  --imt N          Compress baskets on N threads with ROOT implicit multithreading" << std::endl;
+  std::cerr << "  --channel-map F  Channel map from channel_mapper.exe (.chmap), stored in the ROOT file as channelMapTree" << std::endl;
+  std::cerr << "  --wire-order     Also write the crate events in LArSoft wire order, one wires x samples matrix per plane (wireTree; needs --channel-map)" << std::endl;
+  std::cerr << "  --channel-stats  Also write the pedestal, RMS, min/max and stuck bits of every channel (channelStatsTree)" << std::endl;
+  std::cerr << "  --roi            Write only the regions of interest of each channel (roiTree instead of decoderTree)" << std::endl;
+  std::cerr << "  --roi-threshold N  ADC counts from the pedestal that start a region of interest (default 20)" << std::endl;
+  std::cerr << "  --roi-thresholds FILE  Thresholds of some channels, one \"slot channel threshold\" per line" << std::endl;
+  std::cerr << "  --roi-padding PRE:POST  Samples kept before and after the samples over threshold (default 8:8)" << std::endl;
+  std::cerr << "  --build-events   Also group the frames of each trigger into crate events (eventTree)" << std::endl;
+  std::cerr << "  --crate FIRST:N  Slot of the first FEM and number of FEMs of the crate (default 4:10; for --build-events and --wire-order)" << std::endl;
+  std::cerr << "  --event-window N Events kept open waiting for late FEMs (default 4; for --build-events and --wire-order)" << std::endl;
+  std::cerr << "  --verify-only    Only check the word count and checksum of every frame (exit status 0 if all pass, 1 otherwise)" << std::endl;
+  std::cerr << "  --index          Only write the frame index (NEVIS_TPC_BINARY_FILE.idx) used by plotter and analyzer" << std::endl;
+  std::cerr << "  --jobs N         Decode N files at the same time (0: cores/threads, default)" << std::endl;
+  std::cerr << "  --force          Also decode files whose outputs are up to date" << std::endl;
+  std::cerr << "  --list FILE      Also decode the files (or patterns) listed in FILE, one per line" << std::endl;
+  std::cerr << "  --debug          Also print every channel (needs -DDECODER_DEBUG in CXXFLAGS)" << std::endl;
+  std::cerr << "  --check-huffman  Check the Huffman lookup table against the bit-by-bit decoding" << std::endl;
+  std::cerr << "  --check-encoder  Encode random frames, decode them and check that the round trip is bit-exact" << std::endl;
+  std::cerr << "  --check-channel-stats  Check the stuck-bit masks on simulated noisy channels, healthy and with a bit forced" << std::endl;
+}
+
 int main( int argc, char** argv ){
-  return decoder( argv[1] );
+  DecoderOptions options;
+  std::vector<std::string> inFileNames;
+  unsigned jobs = 0;
+  bool force = false;
+  bool batch = false;
+  for(int i = 1; i < argc; i++){
+    std::string arg(argv[i]);
+    if( arg == "--check-huffman" ) return check_huffman_table() ? 0 : 1;
+    else if( arg == "--check-encoder" ) return check_round_trip() ? 0 : 1;
+    else if( arg == "--check-channel-stats" ) return check_channel_stats() ? 0 : 1;
+    else if( arg == "--threads" && i + 1 < argc ) options.threads = std::stoi( argv[++i] );
+    else if( arg == "--quiet" ) options.quiet = true;
+    else if( arg == "--format" && i + 1 < argc ){
+      std::string format( argv[++i] );
+      options.rootOutput = (format == "root" || format == "both");
+      options.nativeOutput = (format == "native" || format == "both");
+      if( !options.rootOutput && !options.nativeOutput ){
+	print_usage();
+	exit(1);
+      }
+    }
+    else if( arg == "--follow" ) options.follow = true;
+    else if( arg == "--follow-timeout" && i + 1 < argc ) options.followTimeout = std::stod( argv[++i] );
+    else if( arg == "--autosave" && i + 1 < argc ) options.autosaveInterval = std::stod( argv[++i] );
+    else if( arg == "--compression" && i + 1 < argc ){
+      options.compression = compression_setting( argv[++i] );
+      if( options.compression < 0 ){
+	print_usage();
+	exit(1);
+      }
+    }
+    else if( arg == "--basket-size" && i + 1 < argc ) options.basketSize = std::stoi( argv[++i] );
+    else if( arg == "--auto-flush" && i + 1 < argc ) options.autoFlush = std::stoll( argv[++i] );
+    else if( arg == "--auto-save" && i + 1 < argc ) options.autoSave = std::stoll( argv[++i] );
+    else if( arg == "--imt" && i + 1 < argc ) options.imtThreads = std::stoi( argv[++i] );
+    else if( arg == "--channel-map" && i + 1 < argc ) options.channelMapFile = argv[++i];
+    else if( arg == "--wire-order" ) options.wireOrder = true;
+    else if( arg == "--channel-stats" ) options.channelStats = true;
+    else if( arg == "--roi" ) options.roi = true;
+    else if( arg == "--roi-threshold" && i + 1 < argc ){
+      options.roiThreshold = std::stoi( argv[++i] );
+      options.roi = true;
+    }
+    else if( arg == "--roi-thresholds" && i + 1 < argc ){
+      options.roiThresholdFile = argv[++i];
+      options.roi = true;
+    }
+    else if( arg == "--roi-padding" && i + 1 < argc ){
+      std::string padding( argv[++i] );
+      options.roiPre = std::atoi( padding.substr( 0, padding.find(':') ).c_str() );
+      options.roiPost = (padding.find(':') != std::string::npos) ? std::atoi( padding.substr( padding.find(':') + 1 ).c_str() ) : options.roiPre;
+      options.roi = true;
+    }
+    else if( arg == "--build-events" ) options.buildEvents = true;
+    else if( arg == "--crate" && i + 1 < argc ){
+      std::string crate( argv[++i] );
+      options.crateFirstSlot = std::atoi( crate.substr( 0, crate.find(':') ).c_str() );
+      options.crateSlots = (crate.find(':') != std::string::npos) ? std::atoi( crate.substr( crate.find(':') + 1 ).c_str() ) : 0;
+      if( options.crateSlots < 1 || options.crateFirstSlot < 0 || options.crateFirstSlot + options.crateSlots > 32 ){
+	print_usage();
+	exit(1);
+      }
+    }
+    else if( arg == "--event-window" && i + 1 < argc ) options.eventWindow = std::stoi( argv[++i] );
+    else if( arg == "--verify-only" ) options.verifyOnly = true;
+    else if( arg == "--index" ) options.indexOnly = true;
+    else if( arg == "--debug" ) set_log_level( kDebug );
+    else if( arg == "--jobs" && i + 1 < argc ){
+      jobs = std::stoi( argv[++i] );
+      batch = true;
+    }
+    else if( arg == "--force" ) force = true;
+    else if( arg == "--list" && i + 1 < argc ){
+      std::ifstream list( argv[++i] );
+      if( !list.is_open() ){
+	std::cerr << "ERROR: Could not open file " << argv[i] << std::endl;
+	exit(1);
+      }
+      std::string line;
+      while( std::getline( list, line ) ){
+	if( !line.empty() && line[0] != '#' ) expand_pattern( line, inFileNames );
+      }
+      batch = true;
+    }
+    else if( arg[0] != '-' ) expand_pattern( arg, inFileNames );
+    else{
+      print_usage();
+      exit(1);
+    }
+  }
+  batch = batch || (inFileNames.size() > 1);
+  if( options.wireOrder && (options.channelMapFile.empty() || !options.rootOutput) ){
+    print_usage();
+    exit(1);
+  }
+  if( inFileNames.empty() || ((options.verifyOnly || options.indexOnly) && options.follow) || (batch && options.follow) ){
+    print_usage();
+    exit(1);
+  }
+  int status = batch ? decode_batch( inFileNames, options, jobs, force ) : decoder( inFileNames[0].c_str(), options );
+  // For scripted integrity checks: 0 when every frame passes, 1 on any failure
+  if( options.verifyOnly ) return (status == 1) ? 0 : 1;
+  return status;
 }
 # endif
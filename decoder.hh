@@ -1,3 +1,10 @@
+#ifndef DECODER_HH
+#define DECODER_HH
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
 
 // Types of words
 enum WordType{
@@ -21,11 +28,72 @@ enum WordType{
   kUnknown
 };
 
+// Decoder state carried from one word to the next
+// Each decoder owns one, so several files can be decoded in the same process
+struct DecoderState{
+  int headerCounter = 0; // Position of the next 0xF... word within the 12-word FEM header
+  size_t currentChannel = 999; // Channel being read (999: none)
+  size_t channelBegin = 0; // Position of the first sample of the channel being read
+
+  void clear(){ // Reset state variables
+    headerCounter = 0;
+    currentChannel = 999;
+    channelBegin = 0;
+  };
+};
+
 // Classify words into one of the types
-WordType get_word_type( uint16_t word );
+WordType get_word_type( uint16_t word, DecoderState& state );
 
 // Decode Huffman code
 int decode_huffman( int zeros );
 
+// Run-time options of the decoder
+struct DecoderOptions{
+  unsigned threads = 1; // Threads decoding FEM frames (1: serial decoding, 0: one per core)
+  bool quiet = false; // Only print errors and the run summary
+  bool rootOutput = true; // Write decoderTree to a .root file
+  bool nativeOutput = false; // Write the native format (see NativeFormat.hh) to a .ndf file
+  bool follow = false; // Decode the file while it is being written
+  double followTimeout = 60.; // Stop following after this many seconds without new data
+  double autosaveInterval = 0.5; // Seconds between saves of the tree to disk while following
+  bool verifyOnly = false; // Only check word counts and checksums (see Verifier.hh), no output file
+  bool indexOnly = false; // Only write the frame index sidecar (see FrameIndex.hh)
+  // Writing of decoderTree (0: ROOT default)
+  int compression = -1; // ROOT compression setting, 100*algorithm + level (e.g. 404: LZ4 level 4, 505: ZSTD level 5; -1: ROOT default)
+  int basketSize = 0; // Bytes per basket of each branch
+  long long autoFlush = 0; // Entries (>0) or bytes (<0) between basket flushes, which also sets the cluster size
+  long long autoSave = 0; // Entries (>0) or bytes (<0) between saves of the tree header
+  unsigned imtThreads = 0; // Threads compressing baskets with ROOT implicit multithreading (0: off)
+  // Crate event building (see EventBuilder.hh)
+  bool buildEvents = false; // Also write eventTree, one entry per trigger
+  int crateFirstSlot = 4; // Slot of the first FEM of the crate
+  int crateSlots = 10; // Number of FEMs of the crate
+  unsigned eventWindow = 4; // Events kept open waiting for late or out-of-order FEMs
+  std::string channelMapFile; // Binary channel map (see ChannelMap.hh), empty for none
+  bool wireOrder = false; // Also write wireTree: crate events in wire order, one matrix per plane (needs channelMapFile)
+  bool channelStats = false; // Also write channelStatsTree: pedestal, RMS, min/max and stuck bits of every channel (see ChannelStats.hh)
+  // Zero suppression (see Roi.hh): roiTree, with only the regions of interest, is written instead of decoderTree
+  bool roi = false;
+  int roiThreshold = 20; // ADC counts from the pedestal
+  std::string roiThresholdFile; // Thresholds of some channels ("slot channel threshold" lines), empty for none
+  int roiPre = 8; // Samples kept before the first sample over threshold
+  int roiPost = 8; // Samples kept after the last one
+};
+
+struct RunSummary;
+
+// ROOT compression setting of "algorithm[:level]" (none, zlib, lzma, lz4 or zstd), or -1 if unknown
+int compression_setting( const std::string& spec );
+
 // Loop over a binary file, interpret words and write them to a ROOT file
+// The counters of the run are copied to "summary" if given
 int decoder( const char* argv );
+int decoder( const char* argv, const DecoderOptions& options, RunSummary* summary = nullptr );
+
+// Decode several binary files at the same time, "jobs" files at a time (0: one job per "options.threads" cores)
+// Files whose outputs are newer than the binary file are skipped, unless "force" is set
+// Returns 1 if all files were decoded (or skipped)
+int decode_batch( const std::vector<std::string>& inFileNames, const DecoderOptions& options, unsigned jobs = 0, bool force = false );
+
+#endif
@@ -0,0 +1,156 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+#include "HeaderInfo.hh"
+#include "Encoder.hh"
+
+// Parameters of the synthetic Nevis TPC binary stream
+struct GeneratorOptions{
+  int events = 100; // Number of triggers
+  int fems = 10; // FEM frames per trigger
+  int firstSlot = 4; // Slot of the first FEM
+  int channels = 64; // Channels read out per FEM (at most 64)
+  int samples = 2560; // Samples per channel and frame
+  int frameStep = 10000; // Frame number difference between triggers
+  double huffmanFraction = 0.95; // Fraction of sample differences within +-3, which can be Huffman-coded
+  bool huffman = true; // Use kADCHuffman words (otherwise every sample is a kADC word)
+  double xmitRate = 0.; // Probability of an XMIT word before each 32-bit word
+  double checksumErrorRate = 0.; // Fraction of frames with a wrong checksum in the header
+  double truncationRate = 0.; // Fraction of frames cut short
+  unsigned seed = 1;
+};
+
+// Write a synthetic binary file. Returns 0 on success
+int generator( const char* outFileName, const GeneratorOptions& options ){
+  std::ofstream outFile( outFileName, std::ios::binary );
+  if( !outFile.is_open() ){
+    std::cerr << "ERROR: Could not create file " << outFileName << std::endl;
+    return 1;
+  }
+
+  std::mt19937 rng( options.seed );
+  std::uniform_real_distribution<double> uniform(0., 1.);
+  std::discrete_distribution<int> smallStep( {3, 7, 20, 40, 20, 7, 3} ); // Differences -3..3
+  std::uniform_int_distribution<int> bigStep(4, 40);
+  std::uniform_int_distribution<int> pedestal(400, 2000);
+
+  std::vector<uint16_t> stream;
+  std::vector<uint16_t> samples;
+  std::vector<uint32_t> offsets(65, 0);
+  std::vector<uint32_t> words32b;
+  size_t nframes = 0;
+  size_t nsamples = 0;
+  size_t ndataWords = 0;
+  size_t nxmit = 0;
+  for(int ev = 0; ev < options.events; ev++){
+    for(int fem = 0; fem < options.fems; fem++){
+      HeaderInfo header;
+      header.slot = options.firstSlot + fem;
+      header.id = header.slot & 0xF;
+      header.event = ev + 1;
+      header.frame = (ev + 1)*options.frameStep;
+      header.triggerframe = header.frame & 0xF;
+      header.triggersample = rng() & 0xFFF;
+
+      samples.clear();
+      for(int ch = 0; ch < 64; ch++){
+	int adc = pedestal(rng);
+	for(int t = 0; ch < options.channels && t < options.samples; t++){
+	  if( t > 0 ){
+	    int step = (uniform(rng) < options.huffmanFraction) ? smallStep(rng) - 3 : ((rng() & 1) ? 1 : -1)*bigStep(rng);
+	    adc = std::min( 4095, std::max( 0, adc + step ) );
+	  }
+	  samples.push_back( adc );
+	}
+	offsets[ch + 1] = samples.size();
+      }
+      nsamples += samples.size();
+
+      size_t frameBegin = stream.size();
+      encode_frame( stream, header, samples.data(), offsets.data(), options.huffman );
+      if( uniform(rng) < options.checksumErrorRate ) stream[frameBegin + 9] ^= 0x1; // Checksum LSB word
+      if( uniform(rng) < options.truncationRate ){ // Header still announces the full frame
+	// Cut at a 32-bit boundary: a padding word inside an open channel would be decoded as one more sample
+	size_t keep = header.nwords*uniform(rng);
+	stream.resize( frameBegin + 12 + keep - keep % 2 );
+      }
+      ndataWords += stream.size() - frameBegin - 12;
+      nframes++;
+    }
+    // Write one trigger at a time, inserting XMIT words between 32-bit words
+    words32b.clear();
+    pack_words( stream, words32b );
+    if( options.xmitRate > 0. ){
+      std::vector<uint32_t> withXmit;
+      withXmit.reserve( words32b.size() );
+      for(size_t w = 0; w < words32b.size(); w++){
+	if( uniform(rng) < options.xmitRate ){
+	  withXmit.push_back( (rng() & 1) ? 0xFFFFFFFF : 0xE0000000 );
+	  nxmit++;
+	}
+	withXmit.push_back( words32b[w] );
+      }
+      words32b.swap( withXmit );
+    }
+    outFile.write( reinterpret_cast<const char*>(words32b.data()), words32b.size()*sizeof(uint32_t) );
+    stream.clear();
+  }
+  double megabytes = outFile.tellp()/1.e6;
+  outFile.close();
+
+  std::cout << "Wrote " << outFileName << ": " << nframes << " frames, " << megabytes << " MB, "
+	    << nxmit << " XMIT words, " << (double)nsamples/ndataWords << " samples per data word" << std::endl;
+  return 0;
+}
+
+// To run as a standalone application
+# ifndef __CINT__
+static void print_usage(){
+  std::cerr << "Usage ./generator.exe [options] OUTPUT.dat" << std::endl;
+  std::cerr << "  --events N          Number of triggers (default 100)" << std::endl;
+  std::cerr << "  --fems N            FEMs per trigger (default 10)" << std::endl;
+  std::cerr << "  --first-slot N      Slot of the first FEM (default 4)" << std::endl;
+  std::cerr << "  --channels N        Channels per FEM (default 64)" << std::endl;
+  std::cerr << "  --samples N         Samples per channel and frame (default 2560)" << std::endl;
+  std::cerr << "  --huffman-fraction F  Fraction of differences within +-3 (default 0.95)" << std::endl;
+  std::cerr << "  --no-huffman        Write every sample as a kADC word" << std::endl;
+  std::cerr << "  --xmit-rate F       Probability of an XMIT word before each 32-bit word (default 0)" << std::endl;
+  std::cerr << "  --checksum-errors F Fraction of frames with a wrong checksum (default 0)" << std::endl;
+  std::cerr << "  --truncated F       Fraction of truncated frames (default 0)" << std::endl;
+  std::cerr << "  --seed N            Random seed (default 1)" << std::endl;
+}
+
+int main( int argc, char** argv ){
+  GeneratorOptions options;
+  std::string outFileName;
+  for(int i = 1; i < argc; i++){
+    std::string arg(argv[i]);
+    bool hasValue = (i + 1 < argc);
+    if( arg == "--events" && hasValue ) options.events = std::stoi( argv[++i] );
+    else if( arg == "--fems" && hasValue ) options.fems = std::stoi( argv[++i] );
+    else if( arg == "--first-slot" && hasValue ) options.firstSlot = std::stoi( argv[++i] );
+    else if( arg == "--channels" && hasValue ) options.channels = std::min( 64, std::stoi( argv[++i] ) );
+    else if( arg == "--samples" && hasValue ) options.samples = std::stoi( argv[++i] );
+    else if( arg == "--huffman-fraction" && hasValue ) options.huffmanFraction = std::stod( argv[++i] );
+    else if( arg == "--no-huffman" ) options.huffman = false;
+    else if( arg == "--xmit-rate" && hasValue ) options.xmitRate = std::stod( argv[++i] );
+    else if( arg == "--checksum-errors" && hasValue ) options.checksumErrorRate = std::stod( argv[++i] );
+    else if( arg == "--truncated" && hasValue ) options.truncationRate = std::stod( argv[++i] );
+    else if( arg == "--seed" && hasValue ) options.seed = std::stoul( argv[++i] );
+    else if( arg[0] != '-' && outFileName.empty() ) outFileName = arg;
+    else{
+      print_usage();
+      exit(1);
+    }
+  }
+  if( outFileName.empty() ){
+    print_usage();
+    exit(1);
+  }
+  return generator( outFileName.c_str(), options );
+}
+# endif
@@ -1,11 +1,19 @@
 #!/bin/sh
+# Optimization flags for decoder.exe (e.g. CXXFLAGS="-O2 -mavx2" ./make.sh to enable the AVX2 Huffman kernel)
+CXXFLAGS=${CXXFLAGS:-"-O2"}
 echo -e "Generating dictionary of decoder.hh and HeaderInfo.hh\n"
 rootcint -f decoder_dict.cc -c decoder.hh HeaderInfo.hh LinkDef.h
 echo -e "Compiling decoder.cc\n"
-g++ decoder_dict.cc decoder.cc -Wall -o decoder.exe `root-config --cflags  --glibs`
+g++ decoder_dict.cc decoder.cc FrameDecoder.cc MappedFile.cc Huffman.cc Logger.cc NativeFormat.cc Encoder.cc Verifier.cc FrameIndex.cc EventBuilder.cc ChannelMap.cc WireOrder.cc ChannelStats.cc Roi.cc -Wall $CXXFLAGS -pthread -o decoder.exe `root-config --cflags  --glibs`
 echo -e "Compiling plotter.cc\n"
-g++ decoder_dict.cc plotter.cc -Wall -o plotter.exe `root-config --cflags  --glibs`
+g++ decoder_dict.cc plotter.cc EventView.cc FrameIndex.cc Verifier.cc FrameDecoder.cc MappedFile.cc Huffman.cc Logger.cc ChannelMap.cc WireOrder.cc Roi.cc -Wall -O2 -pthread -o plotter.exe `root-config --cflags  --glibs`
 echo -e "Compiling channel_mapper.cc\n"
-g++ decoder_dict.cc channel_mapper.cc -Wall -o channel_mapper.exe `root-config --cflags  --glibs`
+g++ decoder_dict.cc channel_mapper.cc EventView.cc ChannelMap.cc -Wall -O2 -pthread -o channel_mapper.exe `root-config --cflags  --glibs`
 echo -e "Compiling analyzer.cc\n"
-g++ decoder_dict.cc analyzer.cc -Wall -o analyzer.exe `root-config --cflags  --glibs`
+g++ decoder_dict.cc analyzer.cc EventView.cc FrameIndex.cc Verifier.cc FrameDecoder.cc MappedFile.cc Huffman.cc Logger.cc -Wall -O2 -pthread -o analyzer.exe `root-config --cflags  --glibs`
+echo -e "Compiling converter.cc\n"
+g++ decoder_dict.cc converter.cc EventView.cc NativeFormat.cc MappedFile.cc Encoder.cc Verifier.cc FrameDecoder.cc Huffman.cc Logger.cc -Wall -O2 -pthread -o converter.exe `root-config --cflags  --glibs`
+echo -e "Compiling generator.cc\n"
+g++ generator.cc Encoder.cc Verifier.cc FrameDecoder.cc Huffman.cc Logger.cc -Wall -O2 -pthread -o generator.exe
+echo -e "Compiling benchmark.cc\n"
+g++ benchmark.cc FrameDecoder.cc MappedFile.cc Huffman.cc Logger.cc -Wall $CXXFLAGS -pthread -o benchmark.exe
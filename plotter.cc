@@ -1,130 +1,451 @@
 #include <iostream>
 #include <iomanip>
 #include <cstdio>
+#include <cstdlib>
 #include <cmath>
 #include <vector>
+#include <string>
+#include <memory>
+#include <algorithm>
+#include <chrono>
+#include <unordered_map>
 
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <TROOT.h>
 #include <TStyle.h>
 #include <TRint.h>
 #include <TFile.h>
 #include <TTree.h>
 #include <TCanvas.h>
 #include <TGraph.h>
-#include <TMultiGraph.h>
+#include <TH1F.h>
+#include <TH2F.h>
 
 #include "HeaderInfo.hh"
+#include "EventView.hh"
+#include "MappedFile.hh"
+#include "FrameIndex.hh"
+#include "FrameDecoder.hh"
+#include "ChannelMap.hh"
+#include "WireOrder.hh"
+#include "Roi.hh"
 
-int plotter( const char* argv ){
-  gStyle->SetOptTitle(1); // Title in canvas
-  gStyle->SetLineWidth(1); // Thinnest lines
-  gStyle->SetTitleOffset(1.2*(gStyle->GetTitleOffset("y")), "y"); // Add 20% offset to the vertical title
-  gStyle->SetPadRightMargin(0.75*(gStyle->GetPadRightMargin()));
-  gStyle->SetPadLeftMargin(1.17*(gStyle->GetPadLeftMargin()));
+// Entries of a decoded file, or frames of a binary file
+// A binary file is not decoded as a whole: each frame is decoded when displayed, found through the index
+class PlotterInput{
+public:
+  bool open( const char* fileName );
+  int entries() const { return fEntries; };
+  void load( int i );
+  // The samples of a ROOT entry are only read when a channel is first touched
+  const HeaderInfo& header(){ return fBinary ? fFrame.header : fView.header(); };
+  size_t size( size_t ch ){ return fBinary ? fFrame.size(ch) : fView.size(ch); };
+  const uint16_t* channel( size_t ch ){ return fBinary ? fFrame.channel(ch) : fView.channel(ch).data(); };
+  long find( uint32_t event, int slot ); // Entry of FEM "slot" in "event", or -1
+  const std::vector<uint32_t>& events(); // Event numbers, in the order they first appear
+
+private:
+  void scan_headers(); // Only for ROOT files: the index of a binary file already has them
+
+  bool fBinary = false;
+  MappedFile fBinFile;
+  FrameIndex fIndex;
+  FrameData fFrame;
+  std::unique_ptr<TFile> fFile;
+  TTree* fTree = nullptr;
+  EventView fView; // Reads flat and legacy (vector of vectors) waveforms
+  int fEntries = 0;
+  bool fScanned = false;
+  std::vector<uint32_t> fEvents;
+  std::unordered_map<uint64_t, long> fLookup; // (event, slot) -> entry
+};
 
-  TFile inFile( argv, "READ" );
-  if( !inFile.IsOpen() ){
-    std::cerr << "Unable to open file: " << argv << std::endl;
-    exit(0);
+bool PlotterInput::open( const char* fileName ){
+  std::string inFileName(fileName);
+  fBinary = (inFileName.substr( inFileName.find_last_of(".") + 1 ) == "dat");
+  if( fBinary ){
+    if( !fBinFile.open( inFileName ) || !fIndex.open( inFileName, fBinFile ) ){
+      std::cerr << "Unable to open file: " << fileName << std::endl;
+      return false;
+    }
+    else std::cout << "Opening file: " << fileName << " (" << fIndex.size() << " frames)" << std::endl;
+    fBinFile.set_random_access();
+    fEntries = fIndex.size();
+    return true;
+  }
+  fFile.reset( new TFile( fileName, "READ" ) );
+  if( !fFile->IsOpen() ){
+    std::cerr << "Unable to open file: " << fileName << std::endl;
+    return false;
   }
-  else std::cout << "Opening file: " << argv << std::endl;
+  else std::cout << "Opening file: " << fileName << std::endl;
 
-  // Get the input tree
-  const char* inTreeName = "decoderTree";
-  TTree *inTree = (TTree*)inFile.Get(inTreeName);
-  if( !inTree ){
-    std::cerr << "Tree not found: " << inTreeName << std::endl;
-    exit(0);
+  // Get the input tree (decoderTree, or roiTree of a zero-suppressed file)
+  fTree = EventView::find_tree( fFile.get() );
+  if( !fTree ){
+    std::cerr << "Tree not found: decoderTree or roiTree" << std::endl;
+    return false;
   }
-  else std::cout << "Tree found: " << inTreeName << std::endl;
+  else std::cout << "Tree found: " << fTree->GetName() << std::endl;
 
-  std::vector< std::vector<uint16_t> >* waveform = NULL;
-  inTree->SetBranchAddress("waveform", &waveform);
-  HeaderInfo* hinfo = NULL;
-  inTree->SetBranchAddress("header", &hinfo);
+  if( !fView.attach( fTree, EventView::kRandom ) ) return false; // Entries are visited in any order
+  fEntries = fView.entries();
+  return true;
+}
 
-  // Canvas showing 64 channels
-  TCanvas* canvas64 = new TCanvas("wfdisplay64", "Waveform display: 64 channels", 1024, 700);
-  int colPad64 = 4; // Number of columns of pads
-  int rowPad64 = 2; // Number of rows of pads
-  canvas64->Divide(colPad64, rowPad64);
+void PlotterInput::load( int i ){
+  if( fBinary ) decode_frame( fBinFile.words(), fIndex.span(i), fFrame );
+  else fView.set_entry(i);
+}
 
+void PlotterInput::scan_headers(){
+  fScanned = true;
+  std::unordered_map<uint32_t, bool> seen;
+  if( fBinary ){
+    for(size_t i = 0; i < fIndex.size(); i++){
+      if( seen.emplace( fIndex.record(i).event, true ).second ) fEvents.push_back( fIndex.record(i).event );
+    }
+    return;
+  }
+  for(int i = 0; i < fEntries; i++){
+    fView.set_entry(i); // Only the headers are read
+    const HeaderInfo& h = fView.header();
+    fLookup.emplace( ((uint64_t)h.event << 8) | h.slot, i ); // First frame, as in the index
+    if( seen.emplace( h.event, true ).second ) fEvents.push_back( h.event );
+  }
+}
+
+long PlotterInput::find( uint32_t event, int slot ){
+  if( fBinary ) return fIndex.find( event, slot );
+  if( !fScanned ) scan_headers();
+  std::unordered_map<uint64_t, long>::const_iterator it = fLookup.find( ((uint64_t)event << 8) | (slot & 0xFF) );
+  return (it == fLookup.end()) ? -1 : it->second;
+}
+
+const std::vector<uint32_t>& PlotterInput::events(){
+  if( !fScanned ) scan_headers();
+  return fEvents;
+}
+
+// Canvases, axis frames and graphs of the display, created once and refilled for every entry
+// - one canvas with 8 pads of 8 channels each, shifted by 100 ADC counts per channel so they do not overlap
+// - four canvases with 16 pads of one channel each
+class WaveformDisplay{
+public:
+  WaveformDisplay();
+  void fill( PlotterInput& input ); // Current entry of the input
+  bool save( const std::string& baseName, const std::string& format, bool allCanvases ) const; // False if an image was not written
+
+private:
+  static const int kColPad64 = 4; // Number of columns of pads
+  static const int kRowPad64 = 2; // Number of rows of pads
+  static const int kChPad64 = 64/(kColPad64*kRowPad64); // Number of channels per pad
+  static const int kColPad16 = 4;
+  static const int kRowPad16 = 4;
+
+  TCanvas* fCanvas64;
+  std::vector<TCanvas*> fCanvases16;
+  std::vector<TH1F*> fFrames64; // Axes of each pad
+  std::vector<TH1F*> fFrames16;
+  std::vector<TGraph*> fGraphs64; // One per channel
+  std::vector<TGraph*> fGraphs16;
+};
+
+WaveformDisplay::WaveformDisplay(){
+  // Canvas showing 64 channels
+  fCanvas64 = new TCanvas("wfdisplay64", "Waveform display: 64 channels", 1024, 700);
+  fCanvas64->Divide(kColPad64, kRowPad64);
   // Four canvases showing 16 channels each
-  std::vector<TCanvas*> vcanvas16(4);
-  int colPad16 = 4; // Number of columns of pads
-  int rowPad16 = 4; // Number of rows of pads
-  for(int c = 0; c < (int)vcanvas16.size(); c++){
-    vcanvas16.at(c) = new TCanvas( Form("wfdisplay16_%i", c), Form("Waveform display: %i-%i channels", c*16, c*16 + 15), 1024, 700);
-    vcanvas16.at(c)->Divide(colPad16, rowPad16);
+  fCanvases16.resize(4);
+  for(int c = 0; c < (int)fCanvases16.size(); c++){
+    fCanvases16[c] = new TCanvas( Form("wfdisplay16_%i", c), Form("Waveform display: %i-%i channels", c*16, c*16 + 15), 1024, 700);
+    fCanvases16[c]->Divide(kColPad16, kRowPad16);
   }
 
-  std::string prompt;
-  int entry = 0;
-  int maxEntry = inTree->GetEntries() - 1;
-  int chPad64 = 64/(colPad64 * rowPad64); // Number of channels per pad
-  // int chPad16 = 64/(int(vcanvas16.size()) * colPad16 * rowPad16); // Number of channels per pad
-  std::vector<TMultiGraph*> vmgr(colPad64 * rowPad64); // Vector of pointers for memory management
-  //  std::vector<TGraph*> vgr2(int(vcanvas16.size()) * colPad16 * rowPad16);
-  std::vector<TGraph*> vgr2; // Vector of pointers for memory management
-  // By using TGraph, it is already assumed that chPad16 will be 1
-  // For a more generic approach, TMultiGraphs should be used
+  // Every pad is drawn once: later entries only change the contents of its frame and graphs
+  for(int ich = 0; ich < 64; ich++){
+    if( (ich % kChPad64) == 0 ){
+      fCanvas64->cd( ich/kChPad64 + 1 );
+      fFrames64.push_back( new TH1F( Form("frame64_%i", ich/kChPad64), "", 1, 0, 1 ) );
+      fFrames64.back()->SetDirectory(nullptr);
+      fFrames64.back()->SetStats(0);
+      fFrames64.back()->Draw("AXIS");
+    }
+    fGraphs64.push_back( new TGraph() );
+    fGraphs64.back()->SetMarkerColor(ich % 8 + 1); // Use ROOT colors 1 - 8
+    fGraphs64.back()->SetLineColor(ich % 8 + 1);
+    fGraphs64.back()->SetNameTitle(Form("ch%i", ich), Form("Channel %i", ich));
+    fGraphs64.back()->Draw("PL");
 
-  while( entry >= 0 && entry <= maxEntry ){
-    inTree->GetEntry(entry);
-    std::cout << "Processing entry " << entry << ": event " << hinfo->event << ", FEM " << (int)(hinfo->slot) << std::endl;
-
-    for(int ich = 0; ich < 64; ich++){
-      TMultiGraph*& mgr = vmgr.at( (size_t)floor(ich/chPad64) ); // Reference pointer
-      if( (ich % chPad64) == 0 ){
-	mgr = new TMultiGraph( Form("ev%ifem%ich%i_%i", hinfo->event, (int)(hinfo->slot), ich, ich + chPad64 -1),
-			       Form("Event %i FEM %i channels %i-%i; Time (#times 500 ns); ADC + 100 #times channel #", 
-				    hinfo->event, (int)(hinfo->slot), ich, ich + chPad64 - 1) );
-      }
-      size_t ichsize = (*waveform)[ich].size();
-      std::vector<int> time(ichsize);
-      std::vector<int> wf(ichsize); // Because TGraph does not accept uint16_t
-      std::vector<int> wfShifted(ichsize); // Shifted copy of the waveform so channels do not overlap
-      if( ichsize > 0 ){
-	// Fill the time vector
-	for(size_t t = 0; t < ichsize; t++){
-	  wf[t] = (int)(*waveform)[ich][t];
-	  wfShifted[t] = wf[t] + ich*100; // Add offset (100.*ich) so channels do not overlap
-	  time[t] = (int)t;
+    fCanvases16[ich/(kColPad16*kRowPad16)]->cd( ich%(kColPad16*kRowPad16) + 1 );
+    fFrames16.push_back( new TH1F( Form("frame16_%i", ich), "", 1, 0, 1 ) );
+    fFrames16.back()->SetDirectory(nullptr);
+    fFrames16.back()->SetStats(0);
+    fFrames16.back()->Draw("AXIS");
+    fGraphs16.push_back( new TGraph() );
+    fGraphs16.back()->SetMarkerColor(ich % 8 + 1);
+    fGraphs16.back()->SetLineColor(ich % 8 + 1);
+    fGraphs16.back()->SetNameTitle(Form("ch%i", ich), Form("Channel %i", ich));
+    fGraphs16.back()->Draw("PL");
+  }
+}
+
+// Copy a waveform into a graph, shifted by "offset", without allocating if the size does not change
+// An empty channel becomes one point left of the axis, so nothing is drawn
+static void fill_graph( TGraph* graph, const uint16_t* adc, size_t n, int offset, double& ymin, double& ymax ){
+  if( graph->GetN() != (int)std::max<size_t>( n, 1 ) ) graph->Set( std::max<size_t>( n, 1 ) );
+  double* x = graph->GetX();
+  double* y = graph->GetY();
+  if( n == 0 ){
+    x[0] = -1.;
+    y[0] = offset;
+    return;
+  }
+  for(size_t t = 0; t < n; t++){
+    x[t] = t;
+    y[t] = adc[t] + offset;
+    ymin = std::min( ymin, y[t] );
+    ymax = std::max( ymax, y[t] );
+  }
+}
+
+// Axis ranges of a frame, with some room above and below the waveforms
+static void set_frame( TH1F* frame, const char* title, size_t nsamples, double ymin, double ymax ){
+  if( ymin > ymax ){ // No samples
+    ymin = 0.;
+    ymax = 1.;
+  }
+  double margin = std::max( 1., 0.05*(ymax - ymin) );
+  frame->SetTitle( title );
+  frame->SetBins( 1, 0, std::max<size_t>( nsamples, 1 ) );
+  frame->SetMinimum( ymin - margin );
+  frame->SetMaximum( ymax + margin );
+}
+
+void WaveformDisplay::fill( PlotterInput& input ){
+  const HeaderInfo& hinfo = input.header();
+  for(int pad = 0; pad < 64/kChPad64; pad++){
+    double ymin = 1e9, ymax = -1e9;
+    size_t nsamples = 0;
+    for(int ich = pad*kChPad64; ich < (pad + 1)*kChPad64; ich++){
+      fill_graph( fGraphs64[ich], input.channel(ich), input.size(ich), ich*100, ymin, ymax ); // Add offset (100.*ich) so channels do not overlap
+      nsamples = std::max( nsamples, input.size(ich) );
+    }
+    set_frame( fFrames64[pad], Form("Event %i FEM %i channels %i-%i; Time (#times 500 ns); ADC + 100 #times channel #",
+				     hinfo.event, (int)(hinfo.slot), pad*kChPad64, (pad + 1)*kChPad64 - 1), nsamples, ymin, ymax );
+    fCanvas64->cd( pad + 1 );
+    gPad->Modified();
+  }
+  for(int ich = 0; ich < 64; ich++){
+    double ymin = 1e9, ymax = -1e9;
+    fill_graph( fGraphs16[ich], input.channel(ich), input.size(ich), 0, ymin, ymax );
+    set_frame( fFrames16[ich], Form("Event %i FEM %i Channel %i; Time (#times 500 ns); ADC", hinfo.event, (int)(hinfo.slot), ich),
+	       input.size(ich), ymin, ymax );
+    fCanvases16[ich/(kColPad16*kRowPad16)]->cd( ich%(kColPad16*kRowPad16) + 1 );
+    gPad->Modified();
+  }
+  fCanvas64->Modified();
+  fCanvas64->Update();
+  for(size_t c = 0; c < fCanvases16.size(); c++){
+    fCanvases16[c]->Modified();
+    fCanvases16[c]->Update();
+  }
+}
+
+// Save a canvas, removing the file first so an image left by an earlier run is not taken for a new one
+static bool save_canvas( TCanvas* canvas, const std::string& fileName ){
+  std::remove( fileName.c_str() );
+  canvas->SaveAs( fileName.c_str() );
+  return access( fileName.c_str(), F_OK ) == 0;
+}
+
+bool WaveformDisplay::save( const std::string& baseName, const std::string& format, bool allCanvases ) const {
+  bool ok = save_canvas( fCanvas64, baseName + "." + format );
+  if( !allCanvases ) return ok;
+  for(size_t c = 0; c < fCanvases16.size(); c++){
+    ok = save_canvas( fCanvases16[c], Form("%s_ch%i-%i.%s", baseName.c_str(), (int)c*16, (int)c*16 + 15, format.c_str()) ) && ok;
+  }
+  return ok;
+}
+
+// Wire x tick display of a whole trigger: one 2D histogram per plane (Induction, Collection...), filled with the
+// pedestal-subtracted samples of every FEM of the crate, placed on their LArSoft wire through the channel map
+// Ticks can be averaged in groups ("downsample") so long readouts stay quick to draw: by default the rows are
+// limited to kMaxTicks
+class EventDisplay{
+public:
+  static const unsigned kMaxTicks = 1000;
+
+  // Returns false if no channel of the crate is connected to a wire
+  bool build( const ChannelMap& channelMap, unsigned firstSlot, unsigned nslots, unsigned downsample = 0 );
+  // Returns the FEMs of the crate found in the event
+  int fill( PlotterInput& input, uint32_t event );
+  bool save( const std::string& baseName, const std::string& format ) const; // False if the image was not written
+
+private:
+  struct Column{
+    size_t plane;
+    int bin; // Wire bin in the plane histogram
+    int ch; // FEM channel
+  };
+
+  unsigned fFirstSlot = 0;
+  unsigned fNSlots = 0;
+  unsigned fDownsample = 0;
+  WireOrder fWireOrder;
+  std::vector< std::vector<Column> > fColumns; // Wires read by each slot of the crate
+  TCanvas* fCanvas = nullptr;
+  std::vector<TH2F*> fPlanes;
+  std::vector<uint16_t> fScratch;
+};
+
+bool EventDisplay::build( const ChannelMap& channelMap, unsigned firstSlot, unsigned nslots, unsigned downsample ){
+  if( !fWireOrder.build( channelMap, firstSlot, nslots ) ) return false;
+  fFirstSlot = firstSlot;
+  fNSlots = nslots;
+  fDownsample = downsample;
+  fColumns.assign( nslots, std::vector<Column>() );
+  fCanvas = new TCanvas("evdisplay", "Event display: wire vs time", 1200, 700);
+  fCanvas->Divide( fWireOrder.nplanes(), 1 );
+  for(size_t p = 0; p < fWireOrder.nplanes(); p++){
+    const std::vector<int32_t>& wires = fWireOrder.wires(p);
+    int firstWire = wires.front(), lastWire = wires.back(); // Increasing order
+    fCanvas->cd( p + 1 );
+    gPad->SetRightMargin(0.15); // Room for the color scale
+    fPlanes.push_back( new TH2F( Form("plane%i", (int)p), Form("%s; LArSoft wire; Time (#times 500 ns)", fWireOrder.plane_name(p).c_str()),
+				 lastWire - firstWire + 1, firstWire - 0.5, lastWire + 0.5, 1, 0, 1 ) );
+    fPlanes.back()->SetDirectory(nullptr);
+    fPlanes.back()->SetStats(0);
+    fPlanes.back()->Draw("COLZ");
+    for(size_t r = 0; r < wires.size(); r++){
+      int c = fWireOrder.channels(p)[r];
+      fColumns[c/64].push_back( Column{ p, wires[r] - firstWire + 1, c % 64 } );
+    }
+  }
+  return true;
+}
+
+int EventDisplay::fill( PlotterInput& input, uint32_t event ){
+  auto start = std::chrono::steady_clock::now();
+  // Nothing of the previous event stays on the display, even if no FEM of the crate is found
+  for(size_t p = 0; p < fPlanes.size(); p++){
+    fPlanes[p]->Reset(); // Wires of missing FEMs stay empty
+    fPlanes[p]->SetTitle( Form("Event %u %s: no data; LArSoft wire; Time (#times 500 ns)", event, fWireOrder.plane_name(p).c_str()) );
+  }
+  int nfems = 0;
+  unsigned downsample = 1;
+  int nticks = 0; // Rows of the histograms
+  for(unsigned s = 0; s < fNSlots; s++){
+    long entry = input.find( event, fFirstSlot + s );
+    if( entry < 0 ) continue; // Its wires stay empty
+    input.load( entry );
+    if( nfems++ == 0 ){
+      // The rows follow the first FEM: longer channels of other FEMs are cut
+      size_t nsamples = 0;
+      for(size_t ch = 0; ch < 64; ch++) nsamples = std::max( nsamples, input.size(ch) );
+      downsample = fDownsample ? fDownsample : std::max<size_t>( 1, (nsamples + kMaxTicks - 1)/kMaxTicks );
+      nticks = std::max<size_t>( 1, (nsamples + downsample - 1)/downsample );
+      for(size_t p = 0; p < fPlanes.size(); p++){
+	TH2F* h = fPlanes[p];
+	if( h->GetNbinsY() != nticks || h->GetYaxis()->GetXmax() != nticks*downsample ){
+	  h->SetBins( h->GetNbinsX(), h->GetXaxis()->GetXmin(), h->GetXaxis()->GetXmax(), nticks, 0, nticks*downsample );
+	  h->Reset();
 	}
-	TGraph *graph = new TGraph( wfShifted.size(), &(time[0]), &(wfShifted[0]) );
-	graph->SetMarkerColor(ich % 8 + 1); // Use ROOT colors 1 - 8
-	graph->SetLineColor(ich % 8 + 1);
-	graph->SetNameTitle(Form("ch%i", ich), Form("Channel %i", ich));
-	mgr->Add(graph);
-
-	// Subset of channels in canvas
-	size_t canvasIndex = (size_t)floor(ich/(colPad16 * rowPad16));
-	//vcanvas16.at( canvasIndex )->cd( colPad16*(ich%rowPad16) + (int)floor(ich/rowPad16) + 1 ); // Plot 64 channels in columns first
-	vcanvas16.at( canvasIndex )->cd( ich%(colPad16 * rowPad16) + 1 );
-	vgr2.push_back( new TGraph( wf.size(), &(time[0]), &(wf[0]) ) );
-	TGraph* graph2 = vgr2.back();
-	graph2->SetMarkerColor(ich % 8 + 1); // Use ROOT colors 1 - 8
-	graph2->SetLineColor(ich % 8 + 1);
-	graph2->SetNameTitle(Form("ch%i", ich), Form("Event %i FEM %i Channel %i; Time (#times 500 ns); ADC", hinfo->event, (int)(hinfo->slot), ich));
-	graph2->Draw("APL");
-	//vcanvas16.at( canvasIndex )->Update();
-      }
-      if( ((ich + 1) % chPad64) == 0 ){
-	canvas64->cd( (int)floor(ich/chPad64) + 1 ); // Plot "chPad64" channels per pad
-	mgr->Draw("APL");
-	//canvas64->Update();
+	h->SetTitle( Form("Event %u %s; LArSoft wire; Time (#times 500 ns)", event, fWireOrder.plane_name(p).c_str()) );
       }
     }
-    canvas64->Update();
-    //canvas64->Print(".png");
-    for(size_t c = 0; c < vcanvas16.size(); c++){
-      vcanvas16.at(c)->Update();
+    for(size_t w = 0; w < fColumns[s].size(); w++){
+      const Column& column = fColumns[s][w];
+      const uint16_t* adc = input.channel( column.ch );
+      const size_t n = std::min<size_t>( input.size( column.ch ), (size_t)nticks*downsample );
+      if( n == 0 ) continue;
+      const float pedestal = median_pedestal( adc, n, fScratch );
+      // Straight into the bin contents: cell (x, y) is x + (nx + 2)*y, with underflow and overflow bins
+      float* cells = fPlanes[column.plane]->GetArray();
+      const size_t stride = fPlanes[column.plane]->GetNbinsX() + 2;
+      for(size_t y = 1, t = 0; t < n; y++){
+	const size_t end = std::min( n, t + downsample );
+	const size_t count = end - t;
+	uint32_t sum = 0;
+	for(; t < end; t++) sum += adc[t];
+	cells[column.bin + stride*y] = (float)sum/count - pedestal;
+      }
     }
-    //vcanvas16.at(0)->SaveAs(Form("wfdisplay16_1_ev%i.png", hinfo->event ));
+  }
+  for(size_t p = 0; p < fPlanes.size(); p++){
+    fPlanes[p]->SetEntries( fPlanes[p]->GetNbinsX()*nticks );
+    fCanvas->cd( p + 1 );
+    gPad->Modified();
+  }
+  double fillSeconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+  fCanvas->Update();
+  double drawSeconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count() - fillSeconds;
+  std::cout << "Event " << event << ": " << nfems << " of " << fNSlots << " FEMs, " << nticks << " rows of " << downsample << " ticks, filled in "
+	    << std::fixed << std::setprecision(1) << 1e3*fillSeconds << " ms, drawn in " << 1e3*drawSeconds << " ms" << std::endl;
+  std::cout.unsetf( std::ios::fixed );
+  return nfems;
+}
+
+bool EventDisplay::save( const std::string& baseName, const std::string& format ) const {
+  return save_canvas( fCanvas, baseName + "." + format );
+}
+
+static void set_style(){
+  gStyle->SetOptTitle(1); // Title in canvas
+  gStyle->SetLineWidth(1); // Thinnest lines
+  gStyle->SetTitleOffset(1.2*(gStyle->GetTitleOffset("y")), "y"); // Add 20% offset to the vertical title
+  gStyle->SetPadRightMargin(0.75*(gStyle->GetPadRightMargin()));
+  gStyle->SetPadLeftMargin(1.17*(gStyle->GetPadLeftMargin()));
+}
+
+struct PlotterOptions{
+  // Event display instead of the waveforms of each FEM
+  std::string channelMapFile; // Binary channel map (.chmap) written by channel_mapper.exe
+  unsigned crateFirstSlot = 4;
+  unsigned crateSlots = 10;
+  unsigned downsample = 0; // Ticks averaged per row (0: as few as needed for EventDisplay::kMaxTicks rows)
+  // Batch rendering
+  std::string entries = "all"; // List of entries (or of events, in file order, for the event display) and ranges, e.g. "0-99,150"
+  std::string format = "png"; // Any format TCanvas::SaveAs knows (png, pdf, svg, ...)
+  std::string outputDir = "."; // Where the images go
+  unsigned jobs = 0; // Worker processes (0: one per core)
+  bool allCanvases = false; // Also save the four 16-channel canvases
+};
+
+static bool open_event_display( const PlotterOptions& options, EventDisplay& display ){
+  ChannelMap channelMap;
+  if( !channelMap.load( options.channelMapFile ) ){
+    std::cerr << "ERROR: Could not read the channel map " << options.channelMapFile << std::endl;
+    return false;
+  }
+  if( !display.build( channelMap, options.crateFirstSlot, options.crateSlots, options.downsample ) ){
+    std::cerr << "ERROR: No channel of the crate is connected to a wire in " << options.channelMapFile << std::endl;
+    return false;
+  }
+  return true;
+}
+
+int plotter( const char* argv ){
+  set_style();
+  PlotterInput input;
+  if( !input.open( argv ) ) exit(0);
+  int maxEntry = input.entries() - 1;
+  WaveformDisplay display;
+
+  std::string prompt;
+  int entry = 0;
+  while( entry >= 0 && entry <= maxEntry ){
+    input.load(entry);
+    std::cout << "Processing entry " << entry << ": event " << input.header().event << ", FEM " << (int)(input.header().slot) << std::endl;
+    display.fill( input );
 
     std::cout << "\nEnter \"n\" for next entry\n";
     std::cout << "Enter \"exit\" to return to ROOT command line\n";
     std::cout << "Enter \"p\" for previous entryt\n";
-    std::cout << "Enter entry number in [0, " << maxEntry << "] to go to that entry" << std::endl;
+    std::cout << "Enter entry number in [0, " << maxEntry << "] to go to that entry\n";
+    std::cout << "Enter \"e EVENT FEM\" to go to the entry of that FEM slot in that event" << std::endl;
 
     std::cin >> prompt;
     if( prompt == "n" ){
@@ -132,6 +453,14 @@ int plotter( const char* argv ){
       else std::cout << "You are displaying the last entry" << std::endl;
     }
     else if( prompt == "exit" ) break;
+    else if( prompt == "e" ){
+      uint32_t event = 0;
+      int slot = -1;
+      std::cin >> event >> slot;
+      long found = input.find( event, slot );
+      if( found >= 0 ) entry = found;
+      else std::cout << "Event " << event << " FEM " << slot << " not found" << std::endl;
+    }
     else if( prompt == "p" ){
       if( entry > 1 ) entry--;
       else std::cout << "You are displaying the first entry" << std::endl;
@@ -145,26 +474,212 @@ int plotter( const char* argv ){
 	std::cout << "Input not recognized" << std::endl;
       }
     }
+  }
+  return 1;
+}
+
+// Interactive wire x tick display of each event of the crate
+int event_display( const char* argv, const PlotterOptions& options ){
+  set_style();
+  PlotterInput input;
+  if( !input.open( argv ) ) exit(0);
+  EventDisplay display;
+  if( !open_event_display( options, display ) ) exit(0);
+  const std::vector<uint32_t>& events = input.events();
+  int maxEvent = events.size() - 1;
+
+  std::string prompt;
+  int i = 0;
+  while( i >= 0 && i <= maxEvent ){
+    if( display.fill( input, events[i] ) == 0 ) std::cout << "No FEM of the crate in event " << events[i] << std::endl;
 
-    // Clean memory
-    for(size_t m = 0; m < vmgr.size(); m++){
-      delete vmgr[m]; // Deleting the TMultiGraph deletes all the TGraphs associated
+    std::cout << "\nEnter \"n\" for next event\n";
+    std::cout << "Enter \"exit\" to return to ROOT command line\n";
+    std::cout << "Enter \"p\" for previous event\n";
+    std::cout << "Enter \"e EVENT\" to go to that event number" << std::endl;
+
+    std::cin >> prompt;
+    if( prompt == "n" ){
+      if( i < maxEvent ) i++;
+      else std::cout << "You are displaying the last event" << std::endl;
     }
-    for(size_t g = 0; g < vgr2.size(); g++){
-      delete vgr2[g];
+    else if( prompt == "exit" ) break;
+    else if( prompt == "e" ){
+      uint32_t event = 0;
+      std::cin >> event;
+      std::vector<uint32_t>::const_iterator it = std::find( events.begin(), events.end(), event );
+      if( it != events.end() ) i = it - events.begin();
+      else std::cout << "Event " << event << " not found" << std::endl;
     }
-    vgr2.clear();
-
+    else if( prompt == "p" ){
+      if( i > 0 ) i--;
+      else std::cout << "You are displaying the first event" << std::endl;
+    }
+    else std::cout << "Input not recognized" << std::endl;
   }
   return 1;
 }
 
+// Entries in "spec" ("all", or a list of entries and ranges: "0-99,150"), false if it cannot be parsed
+static bool parse_entries( const std::string& spec, int nentries, std::vector<int>& entries ){
+  entries.clear();
+  if( spec == "all" ){
+    for(int i = 0; i < nentries; i++) entries.push_back(i);
+    return true;
+  }
+  size_t begin = 0;
+  while( begin <= spec.size() ){
+    size_t end = spec.find( ',', begin );
+    if( end == std::string::npos ) end = spec.size();
+    std::string item = spec.substr( begin, end - begin );
+    size_t dash = item.find('-');
+    char* last = nullptr;
+    long first = std::strtol( item.c_str(), &last, 10 );
+    long second = first;
+    if( last == item.c_str() ) return false;
+    if( dash != std::string::npos ){
+      second = std::strtol( item.c_str() + dash + 1, &last, 10 );
+      if( last == item.c_str() + dash + 1 ) return false;
+    }
+    for(long i = std::max( 0L, first ); i <= second && i < nentries; i++) entries.push_back(i);
+    begin = end + 1;
+  }
+  return true;
+}
+
+// Render "entries" (events for the event display) with one reused display, the entries job, job + jobs, job + 2*jobs... Returns the images that failed
+static int render_entries( const char* fileName, const std::vector<int>& entries, size_t job, size_t jobs, const PlotterOptions& options ){
+  PlotterInput input;
+  if( !input.open( fileName ) ) return entries.size();
+  std::string inFileName(fileName);
+  std::string stem = inFileName.substr( inFileName.find_last_of("/") + 1 );
+  stem = stem.substr( 0, stem.find_last_of(".") );
+  int failed = 0;
+  if( !options.channelMapFile.empty() ){
+    EventDisplay display;
+    if( !open_event_display( options, display ) ) return entries.size();
+    const std::vector<uint32_t>& events = input.events();
+    for(size_t e = job; e < entries.size(); e += jobs){
+      if( display.fill( input, events[entries[e]] ) == 0 ){
+	std::cout << "No FEM of the crate in event " << events[entries[e]] << ": no image written" << std::endl;
+	continue;
+      }
+      std::string baseName = options.outputDir + "/" + stem + Form("_ev%u", events[entries[e]]);
+      if( !display.save( baseName, options.format ) ) failed++;
+    }
+    return failed;
+  }
+  WaveformDisplay display;
+  for(size_t e = job; e < entries.size(); e += jobs){
+    input.load( entries[e] );
+    display.fill( input );
+    std::string baseName = options.outputDir + "/" + stem + Form("_entry%i_ev%u_fem%i", entries[e], input.header().event, (int)input.header().slot);
+    if( !display.save( baseName, options.format, options.allCanvases ) ) failed++;
+  }
+  return failed;
+}
+
+// Render entries to image files, without windows or prompts, on several worker processes
+// Each worker opens the file and keeps its own display. Returns 0 if every image was written
+int plot_batch( const char* fileName, const PlotterOptions& options ){
+  gROOT->SetBatch( true );
+  set_style();
+  int nentries = 0;
+  {
+    PlotterInput input; // Only to count the entries: the workers open the file themselves
+    if( !input.open( fileName ) ) return 1;
+    nentries = options.channelMapFile.empty() ? input.entries() : input.events().size();
+  }
+  std::vector<int> entries;
+  if( !parse_entries( options.entries, nentries, entries ) ){
+    std::cerr << "ERROR: Could not parse the list of entries " << options.entries << std::endl;
+    return 1;
+  }
+  size_t jobs = options.jobs ? options.jobs : std::max( 1L, sysconf( _SC_NPROCESSORS_ONLN ) );
+  jobs = std::max<size_t>( 1, std::min( jobs, entries.size() ) );
+  std::cout << "Rendering " << entries.size() << (options.channelMapFile.empty() ? " entries of " : " events of ") << fileName << " with " << jobs << " workers" << std::endl;
+
+  int failed = 0;
+  if( jobs == 1 ) failed = render_entries( fileName, entries, 0, 1, options );
+  else{
+    std::cout << std::flush;
+    std::vector<pid_t> workers;
+    for(size_t j = 0; j < jobs; j++){
+      pid_t pid = fork();
+      if( pid == 0 ) _exit( std::min( 255, render_entries( fileName, entries, j, jobs, options ) ) );
+      if( pid < 0 ){
+	std::cerr << "ERROR: Could not start worker " << j << std::endl;
+	failed += (entries.size() - j + jobs - 1)/jobs;
+      }
+      else workers.push_back( pid );
+    }
+    for(size_t w = 0; w < workers.size(); w++){
+      int status = 0;
+      if( waitpid( workers[w], &status, 0 ) < 0 || !WIFEXITED(status) ) failed++;
+      else failed += WEXITSTATUS(status);
+    }
+  }
+  if( failed > 0 ) std::cerr << "ERROR: " << failed << " images could not be written" << std::endl;
+  else std::cout << "Images written to " << options.outputDir << std::endl;
+  return failed > 0 ? 1 : 0;
+}
+
 // To run as a standalone application
 # ifndef __CINT__
+static void print_usage(){
+  std::cerr << "Usage ./plotter.exe DECODED_RUN.root|NEVIS_TPC_BINARY_FILE.dat (interactive)" << std::endl;
+  std::cerr << "      ./plotter.exe --batch [options] DECODED_RUN.root|NEVIS_TPC_BINARY_FILE.dat" << std::endl;
+  std::cerr << "  --entries LIST   Entries to render, e.g. 0-99,150 (default all)" << std::endl;
+  std::cerr << "  --format F       Image format: png (default), pdf, svg..." << std::endl;
+  std::cerr << "  --output-dir D   Directory of the images (default .)" << std::endl;
+  std::cerr << "  --jobs N         Worker processes (0: one per core, default)" << std::endl;
+  std::cerr << "  --all-canvases   Also save the four 16-channel canvases of each entry" << std::endl;
+  std::cerr << "Event display (wire vs time, one histogram per plane, interactive or with --batch):" << std::endl;
+  std::cerr << "  --event-display MAP.chmap  Show whole events through the channel map written by channel_mapper.exe" << std::endl;
+  std::cerr << "  --crate FIRST:N  FEMs of the crate: N slots from slot FIRST (default 4:10)" << std::endl;
+  std::cerr << "  --downsample N   Average N ticks per row (default: enough for at most " << EventDisplay::kMaxTicks << " rows)" << std::endl;
+}
+
 int main( int argc, char** argv ){
+  PlotterOptions options;
+  bool batch = false;
+  std::vector<std::string> files;
+  for(int i = 1; i < argc; i++){
+    std::string arg(argv[i]);
+    if( arg == "--batch" ) batch = true;
+    else if( arg == "--entries" && i + 1 < argc ) options.entries = argv[++i];
+    else if( arg == "--format" && i + 1 < argc ) options.format = argv[++i];
+    else if( arg == "--output-dir" && i + 1 < argc ) options.outputDir = argv[++i];
+    else if( arg == "--jobs" && i + 1 < argc ) options.jobs = std::stoi( argv[++i] );
+    else if( arg == "--all-canvases" ) options.allCanvases = true;
+    else if( arg == "--event-display" && i + 1 < argc ) options.channelMapFile = argv[++i];
+    else if( arg == "--crate" && i + 1 < argc ){
+      std::string crate( argv[++i] );
+      int first = std::atoi( crate.substr( 0, crate.find(':') ).c_str() );
+      int nslots = (crate.find(':') != std::string::npos) ? std::atoi( crate.substr( crate.find(':') + 1 ).c_str() ) : 0;
+      if( nslots < 1 || first < 0 || first + nslots > 32 ){
+	print_usage();
+	exit(1);
+      }
+      options.crateFirstSlot = first;
+      options.crateSlots = nslots;
+    }
+    else if( arg == "--downsample" && i + 1 < argc ) options.downsample = std::stoi( argv[++i] );
+    else if( arg[0] != '-' ) files.push_back( arg );
+    else{
+      print_usage();
+      exit(1);
+    }
+  }
+  if( files.size() != 1 ){
+    print_usage();
+    exit(1);
+  }
+  if( batch ) return plot_batch( files[0].c_str(), options );
   // To create interactive windows to see the plots
-  TRint theApp( "tapp", &argc, argv );
-  int status = plotter( theApp.Argv(1) ); // TRint modifies argc & argv!
+  int rintArgc = 1;
+  TRint theApp( "tapp", &rintArgc, argv );
+  int status = options.channelMapFile.empty() ? plotter( files[0].c_str() ) : event_display( files[0].c_str(), options );
   theApp.Run();
   return status;
 }